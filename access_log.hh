@@ -0,0 +1,83 @@
+#ifndef ACCESS_LOG_HH_INCLUDED
+#define ACCESS_LOG_HH_INCLUDED
+
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <stdint.h>
+#include <boost/noncopyable.hpp>
+
+// Access log read one entry at a time, never loaded whole. Each line is
+//   <timestamp> <url> [<bytes>|<seconds>s]
+// with the timestamp in (fractional) seconds and lines in time order; the
+// optional last field is what the viewer got, in bytes or in seconds.
+// Blank lines, '#' comments and lines that do not parse are skipped.
+class AccessLog : private boost::noncopyable {
+public:
+  struct Entry {
+    Entry() : _time(0), _bytes(-1), _duration(-1) {}
+    double _time;
+    std::string _url;
+    int64_t _bytes;      // -1 when not logged
+    double _duration;    // seconds, -1 when not logged
+  };
+
+  AccessLog()
+    : _skipped(0) {
+  }
+
+  bool Open(const std::string& path) {
+    _in.open(path.c_str());
+    return _in.is_open();
+  }
+
+  bool Next(Entry* entry) {
+    std::string line;
+    while (std::getline(_in, line)) {
+      if (Parse(line, entry)) {
+        return true;
+      }
+      if (line.find_first_not_of(" \t\r") != std::string::npos &&
+          line[line.find_first_not_of(" \t\r")] != '#') {
+        _skipped++;
+      }
+    }
+    return false;
+  }
+
+  // malformed lines passed over so far
+  size_t Skipped() const {
+    return _skipped;
+  }
+
+private:
+  static bool Parse(const std::string& line, Entry* entry) {
+    std::istringstream in(line);
+    std::string time, amount;
+    if (!(in >> time >> entry->_url) || time[0] == '#') {
+      return false;
+    }
+    char* end = NULL;
+    entry->_time = strtod(time.c_str(), &end);
+    if (*end) {
+      return false;
+    }
+    entry->_bytes = -1;
+    entry->_duration = -1;
+    if (in >> amount) {
+      if (amount[amount.size() - 1] == 's') {
+        entry->_duration = strtod(amount.c_str(), &end);
+        return *end == 's' && entry->_duration >= 0;
+      }
+      entry->_bytes = strtoll(amount.c_str(), &end, 10);
+      return !*end && entry->_bytes >= 0;
+    }
+    return true;
+  }
+
+  std::ifstream _in;
+  size_t _skipped;
+};
+
+#endif // ACCESS_LOG_HH_INCLUDED
@@ -0,0 +1,306 @@
+#ifndef AGENT_HH_INCLUDED
+#define AGENT_HH_INCLUDED
+
+#include <csignal>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/chrono/include.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/smart_ptr.hpp>
+#include "agent_protocol.hh"
+#include "test_config.hh"
+#include "worker_pool.hh"
+
+// Waits for a controller and runs the tests it sends: the controller's
+// arguments and config text, sliced to this agent's share, on a worker
+// pool of the Procs() the arguments ask for. The combined stats of the
+// workers go back as deltas every REPORT_INTERVAL_MS, and a last time
+// when the workers are done. One controller at a time; one that goes
+// away stops its test, as a signal would.
+class Agent : private boost::noncopyable {
+public:
+  typedef boost::asio::io_service io_service;
+  typedef boost::asio::basic_waitable_timer<
+    boost::chrono::steady_clock> steady_timer;
+  typedef boost::shared_ptr<FrameConnection> ConnectionPtr;
+
+  static const int REPORT_INTERVAL_MS = 1000;
+
+  explicit Agent(const TestConfig& cfg)
+    : _address(cfg.AgentAddress())
+    , _acceptor(_ioServ)
+    , _signals(_ioServ, SIGINT, SIGTERM)
+    , _reportTimer(_ioServ)
+    , _state(STATE_IDLE)
+    , _interrupted(false) {
+  }
+
+  void Run() {
+    if (!Listen()) {
+      return;
+    }
+    _signals.async_wait(boost::bind(&Agent::SignalHandler, this,
+      boost::asio::placeholders::error));
+    Accept();
+    _ioServ.run();
+  }
+
+private:
+  enum State {
+    STATE_IDLE,     // no test
+    STATE_READY,    // a test configured, waiting for START
+    STATE_RUNNING   // workers at it
+  };
+
+  // Anyone reaching the port can have load generated against any target,
+  // so only an explicit host opens it beyond loopback.
+  bool Listen() {
+    std::string host = "127.0.0.1";
+    std::string port = _address;
+    size_t colon = _address.rfind(':');
+    if (colon != std::string::npos) {
+      host = _address.substr(0, colon);
+      port = _address.substr(colon + 1);
+    }
+    boost::system::error_code err;
+    tcp::resolver resolver(_ioServ);
+    tcp::resolver::iterator it =
+      resolver.resolve(tcp::resolver::query(host, port), err);
+    if (!err) {
+      tcp::endpoint endpoint = *it;
+      _acceptor.open(endpoint.protocol(), err);
+      if (!err) {
+        _acceptor.set_option(tcp::acceptor::reuse_address(true), err);
+        _acceptor.bind(endpoint, err);
+      }
+      if (!err) {
+        _acceptor.listen(boost::asio::socket_base::max_connections, err);
+      }
+      if (!err) {
+        std::cout << "agent listening on " << endpoint << std::endl;
+      }
+    }
+    if (err) {
+      std::cout << "can not listen on " << _address << " ("
+                << err.message() << ")\n";
+      return false;
+    }
+    return true;
+  }
+
+  void Accept() {
+    ConnectionPtr conn(new FrameConnection(_ioServ));
+    _acceptor.async_accept(conn->Socket(),
+      boost::bind(&Agent::HandleAccept, this, conn,
+        boost::asio::placeholders::error));
+  }
+
+  void HandleAccept(ConnectionPtr conn,
+                    const boost::system::error_code& err) {
+    if (err == boost::asio::error::operation_aborted) {
+      return;
+    }
+    if (!err) {
+      if (_conn) {
+        // the other controller sees the error and closes
+        conn->Start(&Agent::Ignore, &Agent::Drop);
+        SendError(conn, "busy");
+      } else {
+        _conn = conn;
+        std::cout << "controller " << RemoteAddress(conn) << std::endl;
+        conn->Start(
+          boost::bind(&Agent::HandleMessage, this, conn, _1, _2),
+          boost::bind(&Agent::HandleClose, this, conn, _1));
+      }
+    }
+    Accept();
+  }
+
+  void HandleMessage(ConnectionPtr conn, uint8_t type, FrameReader& reader) {
+    if (conn != _conn) {
+      return;
+    }
+    switch (type) {
+    case AGENT_RUN:
+      Configure(reader);
+      break;
+    case AGENT_START:
+      StartTest();
+      break;
+    case AGENT_STOP:
+      if (_state == STATE_RUNNING) {
+        _pool->Interrupt(SIGINT);
+      }
+      break;
+    default:
+      break;
+    }
+  }
+
+  void HandleClose(ConnectionPtr conn, const boost::system::error_code&) {
+    if (conn != _conn) {
+      return;
+    }
+    std::cout << "controller gone\n";
+    _conn.reset();
+    if (_state == STATE_RUNNING) {
+      _pool->Interrupt(SIGINT);
+    } else {
+      _state = STATE_IDLE;
+    }
+  }
+
+  void Configure(FrameReader& reader) {
+    if (_state != STATE_IDLE) {
+      SendError(_conn, "busy");
+      return;
+    }
+    size_t index = reader.GetUnsigned();
+    size_t count = reader.GetUnsigned();
+    std::vector<std::string> args;
+    for (uint64_t n = reader.GetUnsigned(); n && reader.Ok(); n--) {
+      args.push_back(reader.GetString());
+    }
+    std::string text = reader.GetString();
+    if (!reader.Ok() || index >= count) {
+      SendError(_conn, "bad request");
+      return;
+    }
+    TestConfig cfg(args, text);
+    if (!cfg.IsReady() || !cfg.AgentAddress().empty() ||
+        !cfg.Controlled().empty()) {
+      SendError(_conn, "bad configuration");
+      return;
+    }
+    cfg.Slice(index, count);
+    _cfg.reset(new TestConfig(cfg));
+    _state = STATE_READY;
+    std::cout << "test " << index + 1 << " of " << count << " configured\n";
+    _conn->Send(AGENT_READY);
+  }
+
+  void StartTest() {
+    if (_state != STATE_READY) {
+      SendError(_conn, "not configured");
+      return;
+    }
+    _pool.reset(new WorkerPool(*_cfg, true));
+    if (!_pool->Start(_ioServ, boost::bind(&Agent::TestDone, this))) {
+      _pool.reset();
+      _state = STATE_IDLE;
+      SendError(_conn, "can not start workers");
+      return;
+    }
+    _state = STATE_RUNNING;
+    _interrupted = false;
+    _sent = WorkerStats();
+    std::cout << "test started, " << _pool->Running() << " workers\n";
+    ArmReport();
+  }
+
+  void ArmReport() {
+    _reportTimer.expires_from_now(
+      boost::chrono::milliseconds(REPORT_INTERVAL_MS));
+    _reportTimer.async_wait(boost::bind(&Agent::Report, this,
+      boost::asio::placeholders::error));
+  }
+
+  void Report(const boost::system::error_code& err) {
+    if (err || _state != STATE_RUNNING) {
+      return;
+    }
+    _pool->Collect();
+    SendStats();
+    ArmReport();
+  }
+
+  void SendStats() {
+    WorkerStats now = _pool->Board().Combined();
+    if (_conn) {
+      FrameWriter writer;
+      writer.PutStats(now, _sent);
+      _conn->Send(AGENT_STATS, writer.Data());
+    }
+    _sent = now;
+  }
+
+  // Called from inside the pool, which is let go on the next turn.
+  void TestDone() {
+    _reportTimer.cancel();
+    SendStats();
+    size_t failed = _pool->Failed();
+    std::cout << "test done";
+    if (failed) {
+      std::cout << ", " << failed << " workers failed";
+    }
+    std::cout << std::endl;
+    if (_conn) {
+      FrameWriter writer;
+      writer.PutUnsigned(failed);
+      _conn->Send(AGENT_DONE, writer.Data());
+    }
+    _state = STATE_IDLE;
+    _ioServ.post(boost::bind(&Agent::ReleasePool, this));
+  }
+
+  void ReleasePool() {
+    _pool.reset();
+  }
+
+  void SignalHandler(const boost::system::error_code& err) {
+    if (err) {
+      return;
+    }
+    if (_state != STATE_RUNNING || _interrupted) {
+      std::cout << "\nQuitting\n";
+      if (_pool) {
+        _pool->Interrupt(SIGTERM);
+      }
+      _ioServ.stop();
+      return;
+    }
+    std::cout << "\nInterrupting test, draining " << _pool->Running()
+              << " workers (signal again to quit)\n";
+    _interrupted = true;
+    _pool->Interrupt(SIGINT);
+    _signals.async_wait(boost::bind(&Agent::SignalHandler, this,
+      boost::asio::placeholders::error));
+  }
+
+  static void SendError(ConnectionPtr conn, const std::string& what) {
+    FrameWriter writer;
+    writer.PutString(what);
+    conn->Send(AGENT_ERROR, writer.Data());
+  }
+
+  static std::string RemoteAddress(ConnectionPtr conn) {
+    boost::system::error_code err;
+    tcp::endpoint peer = conn->Socket().remote_endpoint(err);
+    std::stringstream stream;
+    stream << peer;
+    return stream.str();
+  }
+
+  static void Ignore(uint8_t, FrameReader&) {
+  }
+
+  static void Drop(const boost::system::error_code&) {
+  }
+
+  std::string _address;
+  io_service _ioServ;
+  tcp::acceptor _acceptor;
+  boost::asio::signal_set _signals;
+  steady_timer _reportTimer;
+  ConnectionPtr _conn;
+  State _state;
+  bool _interrupted;
+  boost::scoped_ptr<TestConfig> _cfg;
+  boost::scoped_ptr<WorkerPool> _pool;
+  WorkerStats _sent;  // totals the controller has
+};
+
+#endif // AGENT_HH_INCLUDED
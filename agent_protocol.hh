@@ -0,0 +1,392 @@
+#ifndef AGENT_PROTOCOL_HH_INCLUDED
+#define AGENT_PROTOCOL_HH_INCLUDED
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/smart_ptr.hpp>
+#include "test_arena.hh"
+
+using boost::asio::ip::tcp;
+
+// Controller/agent messages. A frame is a 4 byte big-endian length, then
+// a type byte and the body, the length covering both:
+//   RUN    controller -> agent  slice index, slice count, arguments,
+//                               config file text
+//   READY  agent -> controller  the configuration is good to run
+//   ERROR  agent -> controller  why not, as text
+//   START  controller -> agent  fork the workers now
+//   STATS  agent -> controller  what changed since the previous STATS
+//   STOP   controller -> agent  like a signal: drain, and quit the second
+//                               time
+//   DONE   agent -> controller  the workers are gone, the last STATS was
+//                               final; number of workers that failed
+enum AgentMessage {
+  AGENT_RUN = 1,
+  AGENT_READY,
+  AGENT_ERROR,
+  AGENT_START,
+  AGENT_STATS,
+  AGENT_STOP,
+  AGENT_DONE
+};
+
+// Body of a frame being built. Integers are LEB128 varints, signed ones
+// zigzagged first, strings are a length and the bytes.
+class FrameWriter {
+public:
+  void PutUnsigned(uint64_t value) {
+    while (value >= 0x80) {
+      _data.push_back(char(value | 0x80));
+      value >>= 7;
+    }
+    _data.push_back(char(value));
+  }
+
+  void PutSigned(int64_t value) {
+    PutUnsigned((uint64_t(value) << 1) ^ uint64_t(value >> 63));
+  }
+
+  void PutString(const std::string& value) {
+    PutUnsigned(value.size());
+    _data.append(value);
+  }
+
+  // What changed from prev to now, overall and in each scenario phase:
+  // counters as differences, histograms as their changed buckets only,
+  // min and max of averages and the memory peaks as they are.
+  // A second or two of a running test fits in a few hundred bytes.
+  void PutStats(const WorkerStats& now, const WorkerStats& prev) {
+    PutSummary(now._overall, prev._overall);
+    PutUnsigned(now._phaseCount);
+    for (size_t i = 0; i < now._phaseCount; i++) {
+      PutSummary(now._phases[i], prev._phases[i]);
+    }
+    PutUnsigned(now._active);
+    PutSigned(now._received - prev._received);
+    PutUnsigned(now._sessionBytes);
+    PutUnsigned(now._sessionsAtPeak);
+    PutUnsigned(now._maxSessions);
+    PutUnsigned(now._rssGrowth);
+  }
+
+  const std::string& Data() const {
+    return _data;
+  }
+
+private:
+  void PutSummary(const SummaryStats& cur, const SummaryStats& old) {
+    PutAverage(cur._resolving, old._resolving);
+    PutAverage(cur._connecting, old._connecting);
+    PutAverage(cur._recvHeader, old._recvHeader);
+    PutAverage(cur._firstChunk, old._firstChunk);
+    PutAverage(cur._kBytesPerSec, old._kBytesPerSec);
+    PutAverage(cur._response, old._response);
+    PutAverage(cur._download, old._download);
+    PutAverage(cur._stallGap, old._stallGap);
+    PutHistogram(cur._connectHist, old._connectHist);
+    PutHistogram(cur._firstChunkHist, old._firstChunkHist);
+    PutSigned(cur._sizedBodies - old._sizedBodies);
+    PutSigned(cur._chunkedBodies - old._chunkedBodies);
+    PutSigned(cur._closeBodies - old._closeBodies);
+    PutSigned(cur._partialBodies - old._partialBodies);
+    PutSigned(cur._completed - old._completed);
+    PutSigned(cur._left - old._left);
+    PutSigned(cur._stalls - old._stalls);
+    PutSigned(cur._payloadBytes - old._payloadBytes);
+    PutSigned(cur._overheadBytes - old._overheadBytes);
+    for (int i = 0; i < SummaryStats::MAX_ERROR_COUNT; i++) {
+      PutSigned(cur._errors[i] - old._errors[i]);
+    }
+  }
+
+  template <class D, class N>
+  void PutAverage(const Average<D, N>& cur, const Average<D, N>& old) {
+    PutSigned(cur._den - old._den);
+    PutSigned(cur._num - old._num);
+    PutUnsigned(cur._updated);
+    if (cur._updated) {
+      PutSigned(cur._min);
+      PutSigned(cur._max);
+    }
+  }
+
+  void PutHistogram(const Histogram& cur, const Histogram& old) {
+    uint32_t changed = 0;
+    for (uint32_t i = 0; i < Histogram::BUCKETS; i++) {
+      changed += cur.Bucket(i) != old.Bucket(i);
+    }
+    PutUnsigned(changed);
+    uint32_t last = 0;
+    for (uint32_t i = 0; i < Histogram::BUCKETS; i++) {
+      if (cur.Bucket(i) != old.Bucket(i)) {
+        PutUnsigned(i - last);
+        PutUnsigned(cur.Bucket(i) - old.Bucket(i));
+        last = i;
+      }
+    }
+  }
+
+  std::string _data;
+};
+
+// Reads a frame body; any overrun or bad value makes it not Ok() for
+// good, and reads return zeros from then on.
+class FrameReader {
+public:
+  FrameReader(const char* data, size_t size)
+    : _pos(data)
+    , _end(data + size)
+    , _ok(true) {
+  }
+
+  bool Ok() const {
+    return _ok;
+  }
+
+  uint64_t GetUnsigned() {
+    uint64_t value = 0;
+    for (int shift = 0; _ok; shift += 7) {
+      if (_pos == _end || shift > 63) {
+        _ok = false;
+        break;
+      }
+      uint8_t byte = *_pos++;
+      value |= uint64_t(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) {
+        return value;
+      }
+    }
+    return 0;
+  }
+
+  int64_t GetSigned() {
+    uint64_t value = GetUnsigned();
+    return int64_t(value >> 1) ^ -int64_t(value & 1);
+  }
+
+  std::string GetString() {
+    uint64_t size = GetUnsigned();
+    if (!_ok || size > uint64_t(_end - _pos)) {
+      _ok = false;
+      return std::string();
+    }
+    std::string value(_pos, size);
+    _pos += size;
+    return value;
+  }
+
+  // Applies a PutStats() delta to the running totals.
+  void GetStats(WorkerStats* stats) {
+    GetSummary(&stats->_overall);
+    uint64_t phases = GetUnsigned();
+    if (phases > MAX_SHARED_PHASES) {
+      _ok = false;
+      return;
+    }
+    stats->_phaseCount = phases;
+    for (size_t i = 0; i < phases; i++) {
+      GetSummary(&stats->_phases[i]);
+    }
+    stats->_active = GetUnsigned();
+    stats->_received += GetSigned();
+    stats->_sessionBytes = GetUnsigned();
+    stats->_sessionsAtPeak = GetUnsigned();
+    stats->_maxSessions = GetUnsigned();
+    stats->_rssGrowth = GetUnsigned();
+  }
+
+private:
+  void GetSummary(SummaryStats* stats) {
+    SummaryStats& sum = *stats;
+    GetAverage(&sum._resolving);
+    GetAverage(&sum._connecting);
+    GetAverage(&sum._recvHeader);
+    GetAverage(&sum._firstChunk);
+    GetAverage(&sum._kBytesPerSec);
+    GetAverage(&sum._response);
+    GetAverage(&sum._download);
+    GetAverage(&sum._stallGap);
+    GetHistogram(&sum._connectHist);
+    GetHistogram(&sum._firstChunkHist);
+    sum._sizedBodies += GetSigned();
+    sum._chunkedBodies += GetSigned();
+    sum._closeBodies += GetSigned();
+    sum._partialBodies += GetSigned();
+    sum._completed += GetSigned();
+    sum._left += GetSigned();
+    sum._stalls += GetSigned();
+    sum._payloadBytes += GetSigned();
+    sum._overheadBytes += GetSigned();
+    for (int i = 0; i < SummaryStats::MAX_ERROR_COUNT; i++) {
+      sum._errors[i] += GetSigned();
+    }
+  }
+
+  template <class D, class N>
+  void GetAverage(Average<D, N>* avg) {
+    avg->_den += GetSigned();
+    avg->_num += GetSigned();
+    if (GetUnsigned()) {
+      avg->_min = GetSigned();
+      avg->_max = GetSigned();
+      avg->_updated = true;
+    }
+  }
+
+  void GetHistogram(Histogram* hist) {
+    uint64_t changed = GetUnsigned();
+    uint64_t index = 0;
+    for (uint64_t i = 0; i < changed && _ok; i++) {
+      index += GetUnsigned();
+      uint64_t count = GetUnsigned();
+      if (index >= Histogram::BUCKETS) {
+        _ok = false;
+        break;
+      }
+      hist->AddToBucket(index, count);
+    }
+  }
+
+  const char* _pos;
+  const char* _end;
+  bool _ok;
+};
+
+// A TCP connection carrying frames both ways. Reading runs until the
+// connection fails or is closed, writes are queued. Pending handlers
+// hold a reference, so the connection outlives its owner's.
+class FrameConnection : public boost::enable_shared_from_this<FrameConnection>
+                      , private boost::noncopyable {
+public:
+  // frames larger than this are a protocol error
+  static const uint32_t MAX_FRAME_SIZE = 16 * 1024 * 1024;
+
+  typedef boost::function<void (uint8_t, FrameReader&)> MessageHandler;
+  // not called after Close()
+  typedef boost::function<void (const boost::system::error_code&)>
+    CloseHandler;
+
+  explicit FrameConnection(boost::asio::io_service& ioServ)
+    : _socket(ioServ)
+    , _closed(false) {
+  }
+
+  tcp::socket& Socket() {
+    return _socket;
+  }
+
+  void Start(const MessageHandler& onMessage, const CloseHandler& onClose) {
+    _onMessage = onMessage;
+    _onClose = onClose;
+    boost::system::error_code ec;
+    _socket.set_option(tcp::no_delay(true), ec);
+    ReadHeader();
+  }
+
+  void Send(uint8_t type, const std::string& body = std::string()) {
+    if (_closed) {
+      return;
+    }
+    uint32_t size = body.size() + 1;
+    std::string frame;
+    frame.reserve(size + 4);
+    for (int shift = 24; shift >= 0; shift -= 8) {
+      frame.push_back(char(size >> shift));
+    }
+    frame.push_back(char(type));
+    frame.append(body);
+    _queue.push_back(frame);
+    if (_queue.size() == 1) {
+      WriteNext();
+    }
+  }
+
+  void Close() {
+    if (_closed) {
+      return;
+    }
+    _closed = true;
+    boost::system::error_code ec;
+    _socket.close(ec);
+  }
+
+private:
+  void ReadHeader() {
+    boost::asio::async_read(_socket, boost::asio::buffer(_header),
+      boost::bind(&FrameConnection::HandleHeader, shared_from_this(),
+        boost::asio::placeholders::error));
+  }
+
+  void HandleHeader(const boost::system::error_code& err) {
+    if (err) {
+      Fail(err);
+      return;
+    }
+    uint32_t size = 0;
+    for (int i = 0; i < 4; i++) {
+      size = (size << 8) | uint8_t(_header[i]);
+    }
+    if (!size || size > MAX_FRAME_SIZE) {
+      Fail(boost::asio::error::message_size);
+      return;
+    }
+    _body.resize(size);
+    boost::asio::async_read(_socket, boost::asio::buffer(&_body[0], size),
+      boost::bind(&FrameConnection::HandleBody, shared_from_this(),
+        boost::asio::placeholders::error));
+  }
+
+  void HandleBody(const boost::system::error_code& err) {
+    if (err) {
+      Fail(err);
+      return;
+    }
+    FrameReader reader(&_body[1], _body.size() - 1);
+    _onMessage(uint8_t(_body[0]), reader);
+    if (!_closed) {
+      ReadHeader();
+    }
+  }
+
+  void WriteNext() {
+    boost::asio::async_write(_socket, boost::asio::buffer(_queue.front()),
+      boost::bind(&FrameConnection::HandleWrite, shared_from_this(),
+        boost::asio::placeholders::error));
+  }
+
+  void HandleWrite(const boost::system::error_code& err) {
+    if (err) {
+      Fail(err);
+      return;
+    }
+    _queue.pop_front();
+    if (!_queue.empty()) {
+      WriteNext();
+    }
+  }
+
+  void Fail(const boost::system::error_code& err) {
+    if (_closed) {
+      return;
+    }
+    Close();
+    _onClose(err);
+  }
+
+  tcp::socket _socket;
+  char _header[4];
+  std::vector<char> _body;
+  std::deque<std::string> _queue;
+  MessageHandler _onMessage;
+  CloseHandler _onClose;
+  bool _closed;
+};
+
+#endif // AGENT_PROTOCOL_HH_INCLUDED
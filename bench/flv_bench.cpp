@@ -0,0 +1,56 @@
+// Cost of the FLV tag index flvserve paces by, over generated streams:
+// a clean one, and one with gaps, timestamp jumps and a cut last tag.
+#include <iostream>
+#include <string>
+#include <boost/chrono/include.hpp>
+#include "flv_generator.hh"
+#include "flv_tags.hh"
+
+static const int ROUNDS = 50;
+
+typedef boost::chrono::high_resolution_clock hr_clock;
+
+static double Seconds(hr_clock::time_point start) {
+  return boost::chrono::duration<double>(hr_clock::now() - start).count();
+}
+
+static bool Bench(const std::string& name, const std::string& spec) {
+  FLVGenerator generator;
+  if (!generator.Parse(spec)) {
+    std::cout << "bad stream: " << spec << std::endl;
+    return false;
+  }
+  hr_clock::time_point start = hr_clock::now();
+  std::string stream = generator.Generate();
+  double generateSec = Seconds(start);
+
+  FLVIndex index;
+  size_t tags = 0;
+  start = hr_clock::now();
+  for (int i = 0; i < ROUNDS; i++) {
+    index.Build(stream.data(), stream.size());
+    tags += index.Count();
+  }
+  double indexSec = Seconds(start);
+
+  std::cout << "{\"bench\":\"flv_index\",\"stream\":\"" << name << "\""
+            << ",\"bytes\":" << stream.size()
+            << ",\"tags\":" << index.Count()
+            << ",\"duration_ms\":" << index.Duration()
+            << ",\"broken\":" << (index.Broken() ? "true" : "false")
+            << ",\"generate_mb_per_s\":" << stream.size() / 1e6 / generateSec
+            << ",\"index_ns_per_tag\":" << indexSec * 1e9 / tags
+            << ",\"index_mb_per_s\":"
+              << stream.size() / 1e6 * ROUNDS / indexSec
+            << "}" << std::endl;
+  return true;
+}
+
+int main() {
+  if (!Bench("clean", "video=2500,audio=128,seconds=60") ||
+      !Bench("defects", "video=2500,audio=128,seconds=60,"
+                        "gaps=3,jumps=2,truncate=1")) {
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,73 @@
+// Cost of preparing the GET request for every new session: the old
+// per-session streambuf formatting against the shared pre-serialized
+// buffer handed out by HTTPRequestCache.
+#include <iostream>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/chrono/include.hpp>
+#include <boost/smart_ptr.hpp>
+#include "http_request.hh"
+#include "url.hpp"
+
+static const int SESSIONS = 100000;
+static const int URLS = 20;
+
+typedef boost::chrono::high_resolution_clock hr_clock;
+
+static double NsPerSession(hr_clock::time_point start) {
+  boost::chrono::nanoseconds ns = hr_clock::now() - start;
+  return double(ns.count()) / SESSIONS;
+}
+
+int main() {
+  std::vector<std::string> urls;
+  std::vector<urdl::url> parsed;
+  for (int i = 0; i < URLS; i++) {
+    std::stringstream ss;
+    ss << "http://edge.example.com/live/channel" << i << ".flv?token=abcdef";
+    urls.push_back(ss.str());
+    parsed.push_back(urdl::url(ss.str()));
+  }
+
+  std::vector<boost::shared_ptr<boost::asio::streambuf> > perSession;
+  perSession.reserve(SESSIONS);
+  hr_clock::time_point start = hr_clock::now();
+  for (int i = 0; i < SESSIONS; i++) {
+    const urdl::url& url = parsed[i % URLS];
+    boost::shared_ptr<boost::asio::streambuf> buf(new boost::asio::streambuf);
+    std::ostream request_stream(buf.get());
+    std::string path = url.query().empty() ?
+                         url.path() : url.path() + "?" + url.query();
+    request_stream << "GET " << path << " HTTP/1.1\r\n";
+    request_stream << "User-Agent: "
+                   << "Mozilla/5.0 (Windows NT 6.1; WOW64)\r\n";
+    request_stream << "Host: " << url.host() << "\r\n";
+    request_stream << "Accept: */*\r\n";
+    request_stream << "Connection: keep-alive\r\n\r\n";
+    perSession.push_back(buf);
+  }
+  double streambufNs = NsPerSession(start);
+  size_t streambufBytes = sizeof(boost::asio::streambuf) +
+                          perSession[0]->capacity();
+
+  std::vector<RequestBuffer> shared;
+  shared.reserve(SESSIONS);
+  HTTPRequestCache cache;
+  start = hr_clock::now();
+  for (int i = 0; i < SESSIONS; i++) {
+    shared.push_back(cache.Get(i % URLS, parsed[i % URLS]));
+  }
+  double sharedNs = NsPerSession(start);
+  size_t sharedBytes = sizeof(RequestBuffer);
+
+  std::cout << "{\"bench\":\"request_build\",\"sessions\":" << SESSIONS
+            << ",\"urls\":" << URLS
+            << ",\"streambuf_ns_per_session\":" << streambufNs
+            << ",\"streambuf_bytes_per_session\":" << streambufBytes
+            << ",\"shared_ns_per_session\":" << sharedNs
+            << ",\"shared_bytes_per_session\":" << sharedBytes
+            << "}" << std::endl;
+  return 0;
+}
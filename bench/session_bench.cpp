@@ -0,0 +1,285 @@
+// What a session costs the load generator itself: a TestArena in this
+// process against flvserve loops forked on loopback, so that only our
+// side shows in the CPU time and RSS measured here.
+//   cpu_ns_per_mb          unthrottled streams, CPU time per MB received
+//   cpu_us_per_connection  short sessions, CPU time per connection
+//   rss_per_idle_session   RSS growth per trickling (1 KB/s) viewer
+//   rss_per_active_session RSS growth per unthrottled viewer
+//   max_connection_rate    highest arrival rate served without errors
+// Every measurement connects to its own 127.0.0.x, so that sockets left
+// in TIME_WAIT by one do not take the ports of the next.
+#include <csignal>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <malloc.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <boost/bind.hpp>
+#include <boost/chrono/include.hpp>
+#include <boost/thread.hpp>
+#include "flv_generator.hh"
+#include "flv_server.hh"
+#include "shared_slots.hh"
+#include "test_arena.hh"
+#include "test_config.hh"
+
+static const int ACTIVE_SESSIONS = 200;
+static const int IDLE_SESSIONS = 2000;
+static const int SETUP_SESSIONS = 2000;
+static const int THROUGHPUT_SESSIONS = 20;
+static const int RSS_SAMPLE_MS = 20;
+
+typedef boost::chrono::steady_clock steady_clock;
+
+static std::vector<pid_t> servers;
+
+// Forks an origin serving spec, returns its port, 0 when it failed.
+static uint16_t StartServer(const std::string& spec, bool realtime,
+                            bool loop) {
+  FLVGenerator generator;
+  FLVSource source;
+  if (!generator.Parse(spec) || !source.Load(generator.Generate())) {
+    return 0;
+  }
+  FLVServer::Options options;
+  options._realtime = realtime;
+  options._loop = loop;
+  FLVServer server(source, options);
+  if (!server.Listen("0.0.0.0", 0)) {
+    return 0;
+  }
+  pid_t pid = fork();
+  if (pid == 0) {
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    server.Run();
+    _exit(0);
+  }
+  servers.push_back(pid);
+  return pid > 0 ? server.Port() : 0;
+}
+
+static double CpuSeconds() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+         (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+static size_t Rss() {
+  size_t pages = 0, resident = 0;
+  FILE* statm = fopen("/proc/self/statm", "r");
+  if (statm) {
+    if (fscanf(statm, "%zu %zu", &pages, &resident) != 2) {
+      resident = 0;
+    }
+    fclose(statm);
+  }
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+// Highest RSS seen while it runs.
+class RssSampler {
+public:
+  RssSampler()
+    : _peak(Rss())
+    , _stop(false)
+    , _thread(boost::bind(&RssSampler::Sample, this)) {
+  }
+
+  size_t Stop() {
+    __atomic_store_n(&_stop, true, __ATOMIC_RELAXED);
+    _thread.join();
+    return _peak;
+  }
+
+private:
+  void Sample() {
+    while (!__atomic_load_n(&_stop, __ATOMIC_RELAXED)) {
+      _peak = std::max(_peak, Rss());
+      boost::this_thread::sleep_for(
+        boost::chrono::milliseconds(RSS_SAMPLE_MS));
+    }
+  }
+
+  size_t _peak;
+  bool _stop;
+  boost::thread _thread;
+};
+
+struct RunResult {
+  RunResult()
+    : _cpu(0)
+    , _wall(0)
+    , _rssBase(0)
+    , _rssPeak(0) {
+  }
+  WorkerStats _stats;
+  double _cpu;
+  double _wall;
+  size_t _rssBase;
+  size_t _rssPeak;
+};
+
+// One TestArena run of the arguments and config text given.
+static bool Run(const std::vector<std::string>& args,
+                const std::string& config, RunResult* result) {
+  TestConfig cfg(args, config);
+  if (!cfg.IsReady()) {
+    return false;
+  }
+  WorkerSlots slots;
+  if (!slots.Create(1)) {
+    return false;
+  }
+  TestArena arena;
+  arena.SetConfig(cfg);
+  arena.SetWorker(&slots, 0);
+
+  // what earlier runs freed would be reused and not show as growth
+  malloc_trim(0);
+  result->_rssBase = Rss();
+  RssSampler sampler;
+  double cpu = CpuSeconds();
+  steady_clock::time_point start = steady_clock::now();
+  arena.Run();
+  result->_wall = boost::chrono::duration<double>(
+    steady_clock::now() - start).count();
+  result->_cpu = CpuSeconds() - cpu;
+  result->_rssPeak = sampler.Stop();
+  return slots.Read(0, &result->_stats);
+}
+
+static std::vector<std::string> Args(const std::string& url, size_t clients,
+                                     int32_t interval) {
+  std::stringstream n, i;
+  n << clients;
+  i << interval;
+  std::vector<std::string> args;
+  args.push_back("-u");
+  args.push_back(url);
+  args.push_back("-n");
+  args.push_back(n.str());
+  args.push_back("-i");
+  args.push_back(i.str());
+  return args;
+}
+
+static std::string URL(int host, uint16_t port) {
+  std::stringstream url;
+  url << "http://127.0.0." << host << ":" << port << "/live.flv";
+  return url.str();
+}
+
+// Ramps to sessions, holds them, lets them go.
+static std::string HoldScenario(size_t sessions) {
+  std::stringstream config;
+  config << "{\"scenario\":[{\"duration\":2,\"target\":" << sessions << "},"
+         << "{\"duration\":2,\"target\":" << sessions << "}]}";
+  return config.str();
+}
+
+static size_t RssPerSession(const RunResult& result, size_t sessions) {
+  return result._rssPeak > result._rssBase ?
+           (result._rssPeak - result._rssBase) / sessions : 0;
+}
+
+static int Fail(const std::string& what) {
+  std::cout << "session bench: " << what << " failed" << std::endl;
+  for (size_t i = 0; i < servers.size(); i++) {
+    kill(servers[i], SIGKILL);
+  }
+  return 1;
+}
+
+int main() {
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+  signal(SIGPIPE, SIG_IGN);
+
+  // a 20 MB stream, a 1 KB one, a trickle and an endless flood
+  uint16_t bulk = StartServer("video=2500,audio=128,seconds=60", false, false);
+  uint16_t tiny = StartServer("video=0,audio=8,seconds=1", false, false);
+  uint16_t trickle = StartServer("video=0,audio=8,seconds=60", true, true);
+  uint16_t flood = StartServer("video=2500,audio=128,seconds=10", false,
+                               true);
+  if (!bulk || !tiny || !trickle || !flood) {
+    return Fail("starting the origins");
+  }
+
+  RunResult throughput;
+  if (!Run(Args(URL(11, bulk), THROUGHPUT_SESSIONS, 0), "", &throughput)) {
+    return Fail("throughput");
+  }
+  double mb = throughput._stats._received / 1e6;
+
+  RunResult setup;
+  if (!Run(Args(URL(12, tiny), SETUP_SESSIONS, 100), "", &setup)) {
+    return Fail("connection setup");
+  }
+
+  std::vector<std::string> hold;
+  hold.push_back("-c");
+  hold.push_back("scenario");
+  hold.push_back("-u");
+  RunResult idle;
+  hold.push_back(URL(13, trickle));
+  if (!Run(hold, HoldScenario(IDLE_SESSIONS), &idle)) {
+    return Fail("idle sessions");
+  }
+  RunResult active;
+  hold.back() = URL(14, flood);
+  if (!Run(hold, HoldScenario(ACTIVE_SESSIONS), &active)) {
+    return Fail("active sessions");
+  }
+
+  // doubling the arrival rate for a second at a time until sessions fail
+  // or fall behind
+  size_t maxRate = 0;
+  for (size_t rate = 1000, host = 20; rate <= 32000; rate *= 2, host++) {
+    std::stringstream config;
+    config << "{\"scenario\":[{\"duration\":1,\"rate\":" << rate << "}]}";
+    std::vector<std::string> args;
+    args.push_back("-c");
+    args.push_back("scenario");
+    args.push_back("-u");
+    args.push_back(URL(host, tiny));
+    RunResult step;
+    if (!Run(args, config.str(), &step)) {
+      return Fail("connection rate");
+    }
+    const SummaryStats& sum = step._stats._overall;
+    if (sum.Errors() || sum.Attempts() < rate * 0.95) {
+      break;
+    }
+    maxRate = rate;
+  }
+
+  for (size_t i = 0; i < servers.size(); i++) {
+    kill(servers[i], SIGKILL);
+    waitpid(servers[i], NULL, 0);
+  }
+
+  std::cout << "{\"bench\":\"session_cost\""
+            << ",\"recv_mb\":" << mb
+            << ",\"recv_mb_per_s\":" << mb / throughput._wall
+            << ",\"cpu_ns_per_mb\":" << (mb > 0 ? throughput._cpu * 1e9 / mb : 0)
+            << ",\"connections\":" << setup._stats._overall.Attempts()
+            << ",\"connection_errors\":" << setup._stats._overall.Errors()
+            << ",\"cpu_us_per_connection\":"
+              << setup._cpu * 1e6 / std::max(
+                   setup._stats._overall.Attempts(), size_t(1))
+            << ",\"rss_per_idle_session\":"
+              << RssPerSession(idle, IDLE_SESSIONS)
+            << ",\"rss_per_active_session\":"
+              << RssPerSession(active, ACTIVE_SESSIONS)
+            << ",\"max_connection_rate\":" << maxRate
+            << "}" << std::endl;
+  return 0;
+}
@@ -0,0 +1,253 @@
+#ifndef CAPACITY_SEARCH_HH_INCLUDED
+#define CAPACITY_SEARCH_HH_INCLUDED
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <stdint.h>
+#include "scenario.hh"
+
+// Service level a probe has to meet, given as
+//   first_chunk_p99=<ms>,errors=<percent>,stalls=<count>,stall=<ms>
+// in any order and subset; a stall is a gap of at least stall ms in the
+// data of a session that already got some.
+struct SLO {
+  SLO()
+    : _firstChunkP99(500)
+    , _errorRate(0.1)
+    , _stalls(0)
+    , _stallMs(2000) {
+  }
+
+  int32_t _firstChunkP99;
+  double _errorRate;
+  size_t _stalls;
+  int32_t _stallMs;
+
+  bool Parse(const std::string& spec) {
+    std::stringstream in(spec);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+      size_t eq = item.find('=');
+      std::string key = item.substr(0, eq);
+      const char* value = eq == std::string::npos ?
+                            "" : item.c_str() + eq + 1;
+      char* end = NULL;
+      double number = strtod(value, &end);
+      if (*end || end == value || number < 0) {
+        return false;
+      }
+      if (key == "first_chunk_p99") {
+        _firstChunkP99 = int32_t(number);
+      } else if (key == "errors") {
+        _errorRate = number;
+      } else if (key == "stalls") {
+        _stalls = size_t(number);
+      } else if (key == "stall") {
+        _stallMs = int32_t(number);
+      } else {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  std::string Describe() const {
+    std::stringstream stream;
+    stream << "first_chunk p99 <= " << _firstChunkP99 << " ms, errors <= "
+           << _errorRate << "%, stalls (" << _stallMs << " ms) <= "
+           << _stalls;
+    return stream.str();
+  }
+};
+
+// What one probe measured at its concurrency level.
+struct Probe {
+  Probe()
+    : _level(0)
+    , _firstChunkP99(-1)
+    , _sessions(0)
+    , _errors(0)
+    , _stalls(0)
+    , _pass(false) {
+  }
+
+  size_t _level;
+  int64_t _firstChunkP99;  // -1 when no session got data
+  size_t _sessions;        // carried over, or connected or failed to
+  size_t _errors;
+  size_t _stalls;
+  bool _pass;
+
+  double ErrorRate() const {
+    return _sessions ? 100.0 * _errors / _sessions : 0.0;
+  }
+};
+
+// Looks for the highest concurrency at which the SLO still holds, either
+//   step:<min>,<max>,<step>            min, min+step, ... up to the first
+//                                      failing level
+//   binary:<min>,<max>[,<resolution>]  min, max, then bisecting between
+//                                      the best pass and the worst fail
+// Each probe steers concurrency to its level over the ramp, holds it for
+// the hold time and is judged on both. Sessions, lookups and edges carry
+// over from one probe to the next; a probe without a first chunk to time
+// or a session to count fails, it shows nothing about the SLO.
+class CapacitySearch {
+public:
+  enum Mode {
+    SEARCH_NONE,
+    SEARCH_STEPWISE,
+    SEARCH_BINARY
+  };
+
+  CapacitySearch()
+    : _mode(SEARCH_NONE)
+    , _min(0)
+    , _max(0)
+    , _step(0)
+    , _hold(30)
+    , _ramp(5)
+    , _level(0)
+    , _good(0)
+    , _bad(0)
+    , _done(false) {
+  }
+
+  bool Parse(const std::string& spec) {
+    unsigned long lo = 0, hi = 0, step = 0;
+    int used = 0;
+    const char* rest = NULL;
+    if (sscanf(spec.c_str(), "step:%lu,%lu,%lu%n",
+               &lo, &hi, &step, &used) == 3) {
+      _mode = SEARCH_STEPWISE;
+      rest = spec.c_str() + used;
+    } else if (sscanf(spec.c_str(), "binary:%lu,%lu%n",
+                      &lo, &hi, &used) == 2) {
+      _mode = SEARCH_BINARY;
+      rest = spec.c_str() + used;
+      if (sscanf(rest, ",%lu%n", &step, &used) == 1) {
+        rest += used;
+      } else if (hi > lo) {
+        step = std::max((hi - lo) / 100, 1UL);
+      }
+    }
+    if (!rest || *rest || !lo || lo > hi || (!step && lo < hi)) {
+      _mode = SEARCH_NONE;
+      return false;
+    }
+    _min = lo;
+    _max = hi;
+    _step = std::max(step, 1UL);
+    _level = lo;
+    return true;
+  }
+
+  // "hold[,ramp]" in seconds
+  bool ParseProbe(const std::string& spec) {
+    char* end = NULL;
+    _hold = strtod(spec.c_str(), &end);
+    if (*end == ',') {
+      _ramp = strtod(end + 1, &end);
+    }
+    return !*end && _hold > 0 && _ramp >= 0;
+  }
+
+  SLO& Objective() {
+    return _slo;
+  }
+
+  const SLO& Objective() const {
+    return _slo;
+  }
+
+  bool Enabled() const {
+    return _mode != SEARCH_NONE;
+  }
+
+  bool Done() const {
+    return _done;
+  }
+
+  // concurrency of the running probe
+  size_t Level() const {
+    return _level;
+  }
+
+  // Appends the ramp and the hold phase of the running probe.
+  void AddPhases(std::vector<Phase>* phases) const {
+    std::stringstream name;
+    name << "probe " << _probes.size() + 1;
+    Phase ramp;
+    ramp._name = name.str() + " ramp";
+    ramp._duration = _ramp;
+    ramp._target = _level;
+    phases->push_back(ramp);
+
+    Phase hold = ramp;
+    name << " (" << _level << " sessions)";
+    hold._name = name.str();
+    hold._duration = _hold;
+    phases->push_back(hold);
+  }
+
+  // Judges the running probe and picks the level of the next one.
+  void Record(Probe probe) {
+    probe._level = _level;
+    probe._pass = probe._firstChunkP99 >= 0 && probe._sessions &&
+                  probe._firstChunkP99 <= _slo._firstChunkP99 &&
+                  probe.ErrorRate() <= _slo._errorRate &&
+                  probe._stalls <= _slo._stalls;
+    _probes.push_back(probe);
+    if (probe._pass) {
+      _good = std::max(_good, _level);
+    } else if (!_bad || _level < _bad) {
+      _bad = _level;
+    }
+
+    if (_mode == SEARCH_STEPWISE) {
+      _done = !probe._pass || _level + _step > _max;
+      _level += _step;
+    } else if (!_good || _good == _max) {
+      _done = true;
+    } else if (!_bad) {
+      _level = _max;
+    } else {
+      _done = _bad - _good <= _step;
+      _level = _good + (_bad - _good) / 2;
+    }
+  }
+
+  const std::vector<Probe>& Probes() const {
+    return _probes;
+  }
+
+  // highest level that passed, 0 when none did
+  size_t Knee() const {
+    return _good;
+  }
+
+  // lowest level that failed, 0 when none did
+  size_t FirstFailing() const {
+    return _bad;
+  }
+
+private:
+  Mode _mode;
+  size_t _min;
+  size_t _max;
+  size_t _step;
+  double _hold;
+  double _ramp;
+  SLO _slo;
+  size_t _level;
+  size_t _good;
+  size_t _bad;
+  bool _done;
+  std::vector<Probe> _probes;
+};
+
+#endif // CAPACITY_SEARCH_HH_INCLUDED
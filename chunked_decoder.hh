@@ -0,0 +1,138 @@
+#ifndef CHUNKED_DECODER_HH_INCLUDED
+#define CHUNKED_DECODER_HH_INCLUDED
+
+#include <stdint.h>
+#include <cstddef>
+
+// Streaming decoder for Transfer-Encoding: chunked bodies. Chunk data is
+// skipped in whole runs, only the size lines and CRLFs are walked byte by
+// byte, so the cost is per chunk rather than per payload byte.
+class ChunkedDecoder {
+public:
+  enum Result {
+    NEED_MORE,
+    DONE,
+    BAD
+  };
+
+  ChunkedDecoder() {
+    Reset();
+  }
+
+  void Reset() {
+    _state = SIZE_START;
+    _remaining = 0;
+  }
+
+  // Chunk data bytes still expected before the next framing bytes.
+  uint64_t DataRemaining() const {
+    return _state == DATA ? _remaining : 0;
+  }
+
+  // Adds the payload and framing byte counts found in data; *used tells
+  // how many bytes belong to this body (less than len only once DONE).
+  Result Feed(const char* data, size_t len,
+              size_t* payload, size_t* overhead, size_t* used) {
+    size_t i = 0;
+    Result res = NEED_MORE;
+    while (i < len && res == NEED_MORE) {
+      if (_state == DATA) {
+        size_t n = len - i;
+        if (n > _remaining) n = size_t(_remaining);
+        _remaining -= n;
+        *payload += n;
+        i += n;
+        if (!_remaining) _state = DATA_CR;
+        continue;
+      }
+      res = Consume(data[i++]);
+      (*overhead)++;
+    }
+    *used = i;
+    return res;
+  }
+
+private:
+  enum State {
+    SIZE_START,
+    SIZE,
+    EXTENSION,
+    SIZE_LF,
+    DATA,
+    DATA_CR,
+    DATA_LF,
+    TRAILER_START,
+    TRAILER,
+    TRAILER_LF,
+    FINAL_LF,
+    FAIL
+  };
+
+  static int HexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+  }
+
+  Result Consume(char c) {
+    switch (_state) {
+    case SIZE_START:
+    case SIZE: {
+      int v = HexValue(c);
+      if (v >= 0 && _remaining < (uint64_t(1) << 56)) {
+        _remaining = _remaining * 16 + v;
+        _state = SIZE;
+      } else if (_state == SIZE && (c == ';' || c == ' ' || c == '\t')) {
+        _state = EXTENSION;
+      } else if (_state == SIZE && c == '\r') {
+        _state = SIZE_LF;
+      } else {
+        _state = FAIL;
+      }
+      break;
+    }
+    case EXTENSION:
+      if (c == '\r') _state = SIZE_LF;
+      break;
+    case SIZE_LF:
+      if (c != '\n') {
+        _state = FAIL;
+      } else {
+        // the zero-sized chunk ends the body, trailers may follow
+        _state = _remaining ? DATA : TRAILER_START;
+      }
+      break;
+    case DATA_CR:
+      _state = (c == '\r') ? DATA_LF : FAIL;
+      break;
+    case DATA_LF:
+      _state = (c == '\n') ? SIZE_START : FAIL;
+      break;
+    case TRAILER_START:
+      _state = (c == '\r') ? FINAL_LF : TRAILER;
+      break;
+    case TRAILER:
+      if (c == '\r') _state = TRAILER_LF;
+      break;
+    case TRAILER_LF:
+      _state = (c == '\n') ? TRAILER_START : FAIL;
+      break;
+    case FINAL_LF:
+      if (c == '\n') {
+        return DONE;
+      }
+      _state = FAIL;
+      break;
+    case DATA:
+    case FAIL:
+      break;
+    }
+    return _state == FAIL ? BAD : NEED_MORE;
+  }
+
+  State _state;
+  uint64_t _remaining;
+};
+
+#endif // CHUNKED_DECODER_HH_INCLUDED
@@ -0,0 +1,340 @@
+#ifndef CONTROLLER_HH_INCLUDED
+#define CONTROLLER_HH_INCLUDED
+
+#include <csignal>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/chrono/include.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/smart_ptr.hpp>
+#include "agent_protocol.hh"
+#include "stats_board.hh"
+#include "test_config.hh"
+
+// Runs a test on agents of other hosts, each taking an equal slice of the
+// load. All agents are configured first and started together once every
+// one of them is ready; any that fails before the start calls the test
+// off. Until then only connecting is timed, configuring may take long
+// and a ready agent has nothing to say. Afterwards an agent that
+// disconnects or stays silent for AGENT_TIMEOUT_MS is lost: the test goes
+// on without it, and its share of the report is what it sent last.
+class Controller : private boost::noncopyable {
+public:
+  typedef boost::asio::io_service io_service;
+  typedef boost::asio::basic_waitable_timer<
+    boost::chrono::steady_clock> steady_timer;
+  typedef boost::shared_ptr<FrameConnection> ConnectionPtr;
+
+  static const int LIVE_INTERVAL_MS = 1000;
+  static const int AGENT_TIMEOUT_MS = 10000;
+
+  explicit Controller(const TestConfig& cfg)
+    : _cfg(cfg)
+    , _resolver(_ioServ)
+    , _signals(_ioServ, SIGINT, SIGTERM)
+    , _liveTimer(_ioServ)
+    , _board("agent")
+    , _ready(0)
+    , _started(false)
+    , _aborted(false)
+    , _interrupted(false) {
+  }
+
+  // False when the test could not be started on all the agents.
+  bool Run() {
+    const std::vector<std::string>& agents = _cfg.Controlled();
+    _board.Resize(agents.size());
+    _since = boost::chrono::steady_clock::now();
+    for (size_t i = 0; i < agents.size(); i++) {
+      _agents.push_back(Remote(agents[i]));
+    }
+    for (size_t i = 0; i < agents.size() && !_aborted; i++) {
+      Connect(i);
+    }
+    if (_aborted) {
+      return false;
+    }
+    _signals.async_wait(boost::bind(&Controller::SignalHandler, this,
+      boost::asio::placeholders::error));
+    ArmLive();
+    _ioServ.run();
+    return _started && !_aborted;
+  }
+
+  void PrintResult() const {
+    if (!_started) {
+      return;
+    }
+    std::vector<std::string> names, states;
+    for (size_t i = 0; i < _agents.size(); i++) {
+      const Remote& agent = _agents[i];
+      names.push_back("agent " + agent._address);
+      std::stringstream state;
+      if (agent._state == REMOTE_DONE) {
+        state << "done";
+        if (agent._failed) {
+          state << ", " << agent._failed << " workers failed";
+        }
+      } else {
+        state << "lost (" << agent._why << "), stats as last sent";
+      }
+      states.push_back(state.str());
+    }
+    _board.PrintResult(names, states, _cfg.Phases());
+  }
+
+private:
+  enum RemoteState {
+    REMOTE_CONNECTING,
+    REMOTE_CONFIGURING,
+    REMOTE_READY,
+    REMOTE_RUNNING,
+    REMOTE_DONE,
+    REMOTE_LOST
+  };
+
+  struct Remote {
+    explicit Remote(const std::string& address)
+      : _address(address)
+      , _state(REMOTE_CONNECTING)
+      , _failed(0) {
+    }
+    std::string _address;
+    ConnectionPtr _conn;
+    RemoteState _state;
+    boost::chrono::steady_clock::time_point _heard;
+    size_t _failed;
+    std::string _why;
+  };
+
+  void Connect(size_t i) {
+    const std::string& address = _agents[i]._address;
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos) {
+      Fail(i, "no port given");
+      return;
+    }
+    // blocking, but done once for a handful of agents
+    boost::system::error_code err;
+    tcp::resolver::iterator it = _resolver.resolve(tcp::resolver::query(
+      address.substr(0, colon), address.substr(colon + 1)), err);
+    if (err) {
+      Fail(i, err.message());
+      return;
+    }
+    ConnectionPtr conn(new FrameConnection(_ioServ));
+    _agents[i]._conn = conn;
+    boost::asio::async_connect(conn->Socket(), it,
+      boost::bind(&Controller::HandleConnect, this, i,
+        boost::asio::placeholders::error));
+  }
+
+  void HandleConnect(size_t i, const boost::system::error_code& err) {
+    Remote& agent = _agents[i];
+    if (agent._state != REMOTE_CONNECTING || _aborted) {
+      return;
+    }
+    if (err) {
+      Fail(i, err.message());
+      return;
+    }
+    agent._state = REMOTE_CONFIGURING;
+    agent._heard = boost::chrono::steady_clock::now();
+    agent._conn->Start(
+      boost::bind(&Controller::HandleMessage, this, i, _1, _2),
+      boost::bind(&Controller::HandleClose, this, i, _1));
+
+    const std::vector<std::string>& args = _cfg.AgentArgs();
+    FrameWriter writer;
+    writer.PutUnsigned(i);
+    writer.PutUnsigned(_agents.size());
+    writer.PutUnsigned(args.size());
+    for (size_t j = 0; j < args.size(); j++) {
+      writer.PutString(args[j]);
+    }
+    writer.PutString(_cfg.ConfigText());
+    agent._conn->Send(AGENT_RUN, writer.Data());
+  }
+
+  void HandleMessage(size_t i, uint8_t type, FrameReader& reader) {
+    Remote& agent = _agents[i];
+    agent._heard = boost::chrono::steady_clock::now();
+    switch (type) {
+    case AGENT_READY:
+      if (agent._state == REMOTE_CONFIGURING) {
+        agent._state = REMOTE_READY;
+        if (++_ready == _agents.size()) {
+          StartAll();
+        }
+      }
+      break;
+    case AGENT_ERROR:
+      Fail(i, reader.GetString());
+      break;
+    case AGENT_STATS:
+      reader.GetStats(&_board[i]);
+      if (!reader.Ok()) {
+        Fail(i, "bad stats");
+      }
+      break;
+    case AGENT_DONE:
+      agent._failed = reader.GetUnsigned();
+      agent._state = REMOTE_DONE;
+      _board[i]._done = true;
+      _board[i]._active = 0;
+      agent._conn->Close();
+      CheckFinished();
+      break;
+    default:
+      break;
+    }
+  }
+
+  void HandleClose(size_t i, const boost::system::error_code& err) {
+    Fail(i, err == boost::asio::error::eof ? "disconnected" : err.message());
+  }
+
+  void StartAll() {
+    boost::chrono::steady_clock::time_point now =
+      boost::chrono::steady_clock::now();
+    for (size_t i = 0; i < _agents.size(); i++) {
+      _agents[i]._state = REMOTE_RUNNING;
+      _agents[i]._heard = now;
+      _agents[i]._conn->Send(AGENT_START);
+    }
+    _started = true;
+    std::cout << "Test started on " << _agents.size() << " agents\n";
+  }
+
+  // Before the start, any failure calls the whole test off; after it,
+  // the agent is lost.
+  void Fail(size_t i, const std::string& why) {
+    Remote& agent = _agents[i];
+    if (agent._state == REMOTE_DONE || agent._state == REMOTE_LOST) {
+      return;
+    }
+    agent._state = REMOTE_LOST;
+    agent._why = why;
+    _board[i]._active = 0;
+    if (agent._conn) {
+      agent._conn->Close();
+    }
+    std::cout << "agent " << agent._address << ": " << why << std::endl;
+    if (!_started && !_aborted) {
+      std::cout << "Test called off\n";
+      _aborted = true;
+      for (size_t j = 0; j < _agents.size(); j++) {
+        if (_agents[j]._conn) {
+          _agents[j]._conn->Close();
+        }
+      }
+      Finish();
+      return;
+    }
+    CheckFinished();
+  }
+
+  void CheckFinished() {
+    for (size_t i = 0; i < _agents.size(); i++) {
+      if (_agents[i]._state != REMOTE_DONE &&
+          _agents[i]._state != REMOTE_LOST) {
+        return;
+      }
+    }
+    Finish();
+  }
+
+  void Finish() {
+    _liveTimer.cancel();
+    boost::system::error_code ec;
+    _signals.cancel(ec);
+    _resolver.cancel();
+  }
+
+  void ArmLive() {
+    _liveTimer.expires_from_now(
+      boost::chrono::milliseconds(LIVE_INTERVAL_MS));
+    _liveTimer.async_wait(boost::bind(&Controller::Live, this,
+      boost::asio::placeholders::error));
+  }
+
+  void Live(const boost::system::error_code& err) {
+    if (err) {
+      return;
+    }
+    boost::chrono::steady_clock::time_point now =
+      boost::chrono::steady_clock::now();
+    boost::chrono::milliseconds timeout(AGENT_TIMEOUT_MS);
+    size_t running = 0;
+    for (size_t i = 0; i < _agents.size(); i++) {
+      Remote& agent = _agents[i];
+      if (agent._state == REMOTE_CONNECTING) {
+        if (now - _since > timeout) {
+          Fail(i, "connect timed out");
+        }
+      } else if (agent._state == REMOTE_RUNNING) {
+        if (now - agent._heard > timeout) {
+          Fail(i, "silent for too long");
+        }
+      }
+      running += agent._state == REMOTE_RUNNING;
+    }
+    if (_aborted) {
+      return;
+    }
+    if (_started) {
+      _board.PrintLive(running);
+    }
+    ArmLive();
+  }
+
+  void SignalHandler(const boost::system::error_code& err) {
+    if (err) {
+      return;
+    }
+    if (!_started) {
+      std::cout << "\nCalling the test off\n";
+      _aborted = true;
+      for (size_t i = 0; i < _agents.size(); i++) {
+        if (_agents[i]._conn) {
+          _agents[i]._conn->Close();
+        }
+      }
+      Finish();
+      return;
+    }
+    if (_interrupted) {
+      std::cout << "\nStopping the agents' workers\n";
+    } else {
+      std::cout << "\nInterrupting the agents, draining "
+                << "(signal again to quit)\n";
+    }
+    _interrupted = true;
+    for (size_t i = 0; i < _agents.size(); i++) {
+      if (_agents[i]._state == REMOTE_RUNNING) {
+        _agents[i]._conn->Send(AGENT_STOP);
+      }
+    }
+    _signals.async_wait(boost::bind(&Controller::SignalHandler, this,
+      boost::asio::placeholders::error));
+  }
+
+  TestConfig _cfg;
+  io_service _ioServ;
+  tcp::resolver _resolver;
+  boost::asio::signal_set _signals;
+  steady_timer _liveTimer;
+  std::vector<Remote> _agents;
+  StatsBoard _board;
+  boost::chrono::steady_clock::time_point _since;
+  size_t _ready;
+  bool _started;
+  bool _aborted;
+  bool _interrupted;
+};
+
+#endif // CONTROLLER_HH_INCLUDED
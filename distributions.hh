@@ -0,0 +1,222 @@
+#ifndef DISTRIBUTIONS_HH_INCLUDED
+#define DISTRIBUTIONS_HH_INCLUDED
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+
+// xorshift128+, plenty for picking streams and much cheaper than mt19937.
+class FastRandom {
+public:
+  explicit FastRandom(uint64_t seed = 0x9e3779b97f4a7c15ULL) {
+    Seed(seed);
+  }
+
+  void Seed(uint64_t seed) {
+    _s[0] = SplitMix(seed);
+    _s[1] = SplitMix(seed);
+  }
+
+  uint64_t Next() {
+    uint64_t s1 = _s[0];
+    const uint64_t s0 = _s[1];
+    _s[0] = s0;
+    s1 ^= s1 << 23;
+    _s[1] = s1 ^ s0 ^ (s1 >> 17) ^ (s0 >> 26);
+    return _s[1] + s0;
+  }
+
+  // uniform in [0, n), n > 0
+  uint64_t Below(uint64_t n) {
+    return uint64_t((unsigned __int128)Next() * n >> 64);
+  }
+
+  // uniform in [0, 1)
+  double Uniform() {
+    return (Next() >> 11) * (1.0 / 9007199254740992.0);
+  }
+
+private:
+  static uint64_t SplitMix(uint64_t& x) {
+    uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+
+  uint64_t _s[2];
+};
+
+// Walker/Vose alias table: O(n) to build, O(1) per sample whatever the
+// weights, 8 bytes per outcome.
+class AliasTable {
+public:
+  // Negative weights count as zero; false when nothing has weight.
+  bool Build(const std::vector<double>& weights) {
+    size_t n = weights.size();
+    double sum = 0;
+    for (size_t i = 0; i < n; i++) {
+      if (weights[i] > 0) sum += weights[i];
+    }
+    _prob.assign(n, 1.0f);
+    _alias.resize(n);
+    if (!(sum > 0)) {
+      _prob.clear();
+      _alias.clear();
+      return false;
+    }
+
+    std::vector<double> scaled(n);
+    std::vector<uint32_t> small, large;
+    for (size_t i = 0; i < n; i++) {
+      scaled[i] = (weights[i] > 0 ? weights[i] : 0) * n / sum;
+      _alias[i] = i;
+      (scaled[i] < 1.0 ? small : large).push_back(i);
+    }
+    while (!small.empty() && !large.empty()) {
+      uint32_t s = small.back();
+      uint32_t l = large.back();
+      small.pop_back();
+      _prob[s] = float(scaled[s]);
+      _alias[s] = l;
+      scaled[l] -= 1.0 - scaled[s];
+      if (scaled[l] < 1.0) {
+        large.pop_back();
+        small.push_back(l);
+      }
+    }
+    // leftovers are 1 up to rounding
+    return true;
+  }
+
+  size_t Size() const {
+    return _prob.size();
+  }
+
+  size_t Sample(FastRandom& rnd) const {
+    size_t i = rnd.Below(_prob.size());
+    return rnd.Uniform() < _prob[i] ? i : _alias[i];
+  }
+
+private:
+  std::vector<float> _prob;
+  std::vector<uint32_t> _alias;
+};
+
+// Weights of ranks 0..n-1 under Zipf's law with exponent s.
+inline std::vector<double> ZipfWeights(double s, size_t n) {
+  std::vector<double> weights(n);
+  for (size_t i = 0; i < n; i++) {
+    weights[i] = 1.0 / std::pow(double(i + 1), s);
+  }
+  return weights;
+}
+
+// Viewer watch time in seconds, given as
+//   exp:<mean>                 exponential
+//   lognormal:<mu>,<sigma>     lognormal, median e^mu
+//   cdf:<file>                 empirical CDF, "<seconds> <fraction>" per
+//                              line in increasing order, interpolated
+class WatchTime {
+public:
+  WatchTime()
+    : _kind(NONE)
+    , _a(0)
+    , _b(0) {
+  }
+
+  bool Parse(const std::string& spec) {
+    size_t colon = spec.find(':');
+    std::string kind = spec.substr(0, colon);
+    std::string args = colon == std::string::npos ?
+                         std::string() : spec.substr(colon + 1);
+    char* end = NULL;
+    if (kind == "exp") {
+      _kind = EXPONENTIAL;
+      _a = strtod(args.c_str(), &end);
+      return *end == '\0' && _a > 0;
+    } else if (kind == "lognormal") {
+      _kind = LOGNORMAL;
+      _a = strtod(args.c_str(), &end);
+      if (*end != ',') {
+        return false;
+      }
+      _b = strtod(end + 1, &end);
+      return *end == '\0' && _b >= 0;
+    } else if (kind == "cdf") {
+      _kind = EMPIRICAL;
+      return LoadCDF(args);
+    }
+    return false;
+  }
+
+  bool Enabled() const {
+    return _kind != NONE;
+  }
+
+  double Sample(FastRandom& rnd) const {
+    switch (_kind) {
+    case EXPONENTIAL:
+      return -_a * std::log(1.0 - rnd.Uniform());
+    case LOGNORMAL: {
+      // Box-Muller
+      double u = 1.0 - rnd.Uniform();
+      double v = rnd.Uniform();
+      double z = std::sqrt(-2.0 * std::log(u)) * std::cos(2 * M_PI * v);
+      return std::exp(_a + _b * z);
+    }
+    case EMPIRICAL: {
+      double u = rnd.Uniform();
+      size_t i = std::lower_bound(_fractions.begin(), _fractions.end(), u) -
+                 _fractions.begin();
+      if (i == 0) {
+        return _seconds.front();
+      }
+      if (i == _fractions.size()) {
+        return _seconds.back();
+      }
+      double span = _fractions[i] - _fractions[i - 1];
+      double w = span > 0 ? (u - _fractions[i - 1]) / span : 1.0;
+      return _seconds[i - 1] + w * (_seconds[i] - _seconds[i - 1]);
+    }
+    case NONE:
+      break;
+    }
+    return 0;
+  }
+
+private:
+  enum Kind {
+    NONE,
+    EXPONENTIAL,
+    LOGNORMAL,
+    EMPIRICAL
+  };
+
+  bool LoadCDF(const std::string& path) {
+    std::ifstream in(path.c_str());
+    double seconds, fraction;
+    while (in >> seconds >> fraction) {
+      if (seconds < 0 || fraction < 0 || fraction > 1 ||
+          (!_seconds.empty() && (seconds < _seconds.back() ||
+                                 fraction < _fractions.back()))) {
+        return false;
+      }
+      _seconds.push_back(seconds);
+      _fractions.push_back(fraction);
+    }
+    return in.eof() && !_seconds.empty();
+  }
+
+  Kind _kind;
+  double _a;
+  double _b;
+  std::vector<double> _seconds;
+  std::vector<double> _fractions;
+};
+
+#endif // DISTRIBUTIONS_HH_INCLUDED
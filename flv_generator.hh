@@ -0,0 +1,309 @@
+#ifndef FLV_GENERATOR_HH_INCLUDED
+#define FLV_GENERATOR_HH_INCLUDED
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <stdint.h>
+#include "distributions.hh"
+#include "flv_tags.hh"
+
+// Synthetic FLV stream, the same bytes for the same spec:
+//   video=<kbps>,fps=<n>,gop=<ms>,key=<factor>,audio=<kbps>,aframe=<ms>,
+//   seconds=<n>,seed=<n>,gaps=<n>,gap=<ms>,jumps=<n>,jump=<ms>,truncate=1
+// in any order and subset; a zero bitrate leaves the track out.
+// onMetaData and the AVC/AAC sequence headers open the stream. Then a
+// video tag per frame, a keyframe key times the size of the other frames
+// every gop ms, and an audio tag every aframe ms follow in timestamp
+// order. Bodies are random filler, sized so each track keeps its
+// bitrate.
+//
+// Defects, spread evenly over the stream: gaps stretches of gap ms with
+// no tags at all, jumps timestamp leaps of jump ms forward, and with
+// truncate the stream ends halfway through its last tag.
+class FLVGenerator {
+public:
+  FLVGenerator()
+    : _videoKbps(1000)
+    , _fps(25)
+    , _gopMs(2000)
+    , _keyFactor(4)
+    , _audioKbps(128)
+    , _audioFrameMs(23.22)
+    , _seconds(60)
+    , _seed(1)
+    , _gaps(0)
+    , _gapMs(2000)
+    , _jumps(0)
+    , _jumpMs(10000)
+    , _truncate(false) {
+  }
+
+  bool Parse(const std::string& spec) {
+    std::stringstream in(spec);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+      size_t eq = item.find('=');
+      std::string key = item.substr(0, eq);
+      const char* value = eq == std::string::npos ?
+                            "" : item.c_str() + eq + 1;
+      char* end = NULL;
+      double number = strtod(value, &end);
+      if (*end || end == value || number < 0) {
+        return false;
+      }
+      if (key == "video") {
+        _videoKbps = number;
+      } else if (key == "fps") {
+        _fps = number;
+      } else if (key == "gop") {
+        _gopMs = uint32_t(number);
+      } else if (key == "key") {
+        _keyFactor = number;
+      } else if (key == "audio") {
+        _audioKbps = number;
+      } else if (key == "aframe") {
+        _audioFrameMs = number;
+      } else if (key == "seconds") {
+        _seconds = number;
+      } else if (key == "seed") {
+        _seed = uint64_t(number);
+      } else if (key == "gaps") {
+        _gaps = uint32_t(number);
+      } else if (key == "gap") {
+        _gapMs = uint32_t(number);
+      } else if (key == "jumps") {
+        _jumps = uint32_t(number);
+      } else if (key == "jump") {
+        _jumpMs = uint32_t(number);
+      } else if (key == "truncate") {
+        _truncate = number != 0;
+      } else {
+        return false;
+      }
+    }
+    return (_videoKbps > 0 || _audioKbps > 0) && _fps > 0 &&
+           _keyFactor > 0 && _audioFrameMs > 0 && _seconds > 0;
+  }
+
+  std::string Describe() const {
+    std::stringstream stream;
+    if (_videoKbps > 0) {
+      stream << _videoKbps << " kbit/s video at " << _fps << " fps, gop "
+             << _gopMs << " ms, ";
+    }
+    if (_audioKbps > 0) {
+      stream << _audioKbps << " kbit/s audio, ";
+    }
+    stream << _seconds << " s";
+    if (_gaps) {
+      stream << ", " << _gaps << " gaps of " << _gapMs << " ms";
+    }
+    if (_jumps) {
+      stream << ", " << _jumps << " jumps of " << _jumpMs << " ms";
+    }
+    if (_truncate) {
+      stream << ", truncated";
+    }
+    return stream.str();
+  }
+
+  std::string Generate() const {
+    bool video = _videoKbps > 0;
+    bool audio = _audioKbps > 0;
+    uint32_t length = uint32_t(_seconds * 1000);
+    std::string out;
+    out.reserve(size_t((_videoKbps + _audioKbps) * 125 * _seconds) + 4096);
+
+    unsigned char header[flv::FILE_HEADER_SIZE + flv::PREV_SIZE_SIZE] = {
+      'F', 'L', 'V', 0x01, 0, 0, 0, 0, flv::FILE_HEADER_SIZE, 0, 0, 0, 0
+    };
+    header[4] = (audio ? 0x04 : 0) | (video ? 0x01 : 0);
+    out.append(reinterpret_cast<char*>(header), sizeof(header));
+    AppendMetaData(&out);
+
+    FastRandom random(_seed);
+    if (video) {
+      // minimal decoder configuration record
+      static const unsigned char config[] = {
+        0x17, 0x00, 0x00, 0x00, 0x00,
+        0x01, 0x42, 0xc0, 0x1e, 0xff, 0xe0, 0x00, 0x00, 0x01, 0x00, 0x00
+      };
+      AppendTag(&out, flv::TAG_VIDEO, 0, config, sizeof(config), NULL);
+    }
+    if (audio) {
+      // AAC LC, 44.1 kHz, stereo
+      static const unsigned char config[] = { 0xaf, 0x00, 0x12, 0x10 };
+      AppendTag(&out, flv::TAG_AUDIO, 0, config, sizeof(config), NULL);
+    }
+
+    // frame sizes so that a gop averages out to the bitrate
+    double frameBytes = _videoKbps * 125 / _fps;
+    double gopFrames = std::max(_gopMs * _fps / 1000, 1.0);
+    double scale = gopFrames / (gopFrames - 1 + _keyFactor);
+    uint32_t keyBytes = uint32_t(frameBytes * _keyFactor * scale);
+    uint32_t deltaBytes = uint32_t(frameBytes * scale);
+    uint32_t audioBytes = uint32_t(_audioKbps * 125 * _audioFrameMs / 1000);
+
+    uint64_t frame = 0, sample = 0;
+    uint32_t lastKey = 0;
+    bool first = true;
+    size_t lastTag = out.size();
+    for (;;) {
+      uint32_t videoTime = video ? uint32_t(frame * 1000 / _fps) : length;
+      uint32_t audioTime = audio ? uint32_t(sample * _audioFrameMs) : length;
+      uint32_t time = std::min(videoTime, audioTime);
+      if (time >= length) {
+        break;
+      }
+      bool isVideo = videoTime <= audioTime;
+      if (isVideo) {
+        frame++;
+      } else {
+        sample++;
+      }
+      if (InGap(time, length)) {
+        continue;
+      }
+      lastTag = out.size();
+      uint32_t stamp = time + Jumped(time, length);
+      if (isVideo) {
+        bool key = first || time - lastKey >= _gopMs;
+        if (key) {
+          lastKey = time;
+          first = false;
+        }
+        // frame type and codec, NALU packet, zero composition time
+        unsigned char lead[] = {
+          (unsigned char)(key ? 0x17 : 0x27), 0x01, 0x00, 0x00, 0x00
+        };
+        uint32_t size = std::max(key ? keyBytes : deltaBytes,
+                                 uint32_t(sizeof(lead)));
+        AppendTag(&out, flv::TAG_VIDEO, stamp, lead, sizeof(lead), &random,
+                  size - sizeof(lead));
+      } else {
+        // AAC raw frame
+        unsigned char lead[] = { 0xaf, 0x01 };
+        uint32_t size = std::max(audioBytes, uint32_t(sizeof(lead)));
+        AppendTag(&out, flv::TAG_AUDIO, stamp, lead, sizeof(lead), &random,
+                  size - sizeof(lead));
+      }
+    }
+    if (_truncate) {
+      out.resize(lastTag + (out.size() - lastTag) / 2);
+    }
+    return out;
+  }
+
+private:
+  // Defect k of n sits at (k + 1) / (n + 1) of the stream.
+  static uint32_t DefectTime(uint32_t k, uint32_t n, uint32_t length) {
+    return uint32_t(uint64_t(length) * (k + 1) / (n + 1));
+  }
+
+  bool InGap(uint32_t time, uint32_t length) const {
+    for (uint32_t k = 0; k < _gaps; k++) {
+      uint32_t start = DefectTime(k, _gaps, length);
+      if (time >= start && time < start + _gapMs) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  uint32_t Jumped(uint32_t time, uint32_t length) const {
+    uint32_t total = 0;
+    for (uint32_t k = 0; k < _jumps; k++) {
+      if (time >= DefectTime(k, _jumps, length)) {
+        total += _jumpMs;
+      }
+    }
+    return total;
+  }
+
+  // onMetaData, an AMF0 name and an ECMA array of numbers
+  void AppendMetaData(std::string* out) const {
+    std::string body;
+    AppendAMFString(&body, "onMetaData");
+    const char* names[] = {
+      "duration", "width", "height", "framerate", "videodatarate",
+      "videocodecid", "audiodatarate", "audiocodecid", "audiosamplerate"
+    };
+    double values[] = {
+      _seconds, 1280, 720, _fps, _videoKbps, 7, _audioKbps, 10, 44100
+    };
+    size_t count = sizeof(values) / sizeof(values[0]);
+    unsigned char array[5] = { 0x08 };
+    flv::PutBE32(array + 1, count);
+    body.append(reinterpret_cast<char*>(array), sizeof(array));
+    for (size_t i = 0; i < count; i++) {
+      uint16_t size = strlen(names[i]);
+      body.push_back(char(size >> 8));
+      body.push_back(char(size));
+      body.append(names[i]);
+      AppendAMFNumber(&body, values[i]);
+    }
+    body.append("\x00\x00\x09", 3);
+    AppendTag(out, flv::TAG_SCRIPT, 0,
+              reinterpret_cast<const unsigned char*>(body.data()),
+              body.size(), NULL);
+  }
+
+  static void AppendAMFString(std::string* out, const std::string& value) {
+    out->push_back(0x02);
+    out->push_back(char(value.size() >> 8));
+    out->push_back(char(value.size()));
+    out->append(value);
+  }
+
+  static void AppendAMFNumber(std::string* out, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    out->push_back(0x00);
+    for (int shift = 56; shift >= 0; shift -= 8) {
+      out->push_back(char(bits >> shift));
+    }
+  }
+
+  // The tag's body is lead followed by fill bytes of filler.
+  static void AppendTag(std::string* out, uint8_t type, uint32_t time,
+                        const unsigned char* lead, uint32_t leadSize,
+                        FastRandom* random, uint32_t fill = 0) {
+    uint32_t bodySize = std::min(leadSize + fill, flv::MAX_BODY_SIZE);
+    fill = bodySize - leadSize;
+    unsigned char tag[flv::TAG_HEADER_SIZE] = { 0 };
+    tag[0] = type;
+    flv::PutBE24(tag + 1, bodySize);
+    flv::PutBE24(tag + 4, time);
+    tag[7] = time >> 24;
+    out->append(reinterpret_cast<char*>(tag), sizeof(tag));
+    out->append(reinterpret_cast<const char*>(lead), leadSize);
+    size_t at = out->size();
+    out->resize(at + fill);
+    for (uint32_t i = 0; i < fill; i += 8) {
+      uint64_t bytes = random->Next();
+      memcpy(&(*out)[at + i], &bytes, std::min(fill - i, 8U));
+    }
+    unsigned char size[flv::PREV_SIZE_SIZE];
+    flv::PutBE32(size, flv::TAG_HEADER_SIZE + bodySize);
+    out->append(reinterpret_cast<char*>(size), sizeof(size));
+  }
+
+  double _videoKbps;
+  double _fps;
+  uint32_t _gopMs;
+  double _keyFactor;
+  double _audioKbps;
+  double _audioFrameMs;
+  double _seconds;
+  uint64_t _seed;
+  uint32_t _gaps;
+  uint32_t _gapMs;
+  uint32_t _jumps;
+  uint32_t _jumpMs;
+  bool _truncate;
+};
+
+#endif // FLV_GENERATOR_HH_INCLUDED
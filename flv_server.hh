@@ -0,0 +1,492 @@
+#ifndef FLV_SERVER_HH_INCLUDED
+#define FLV_SERVER_HH_INCLUDED
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <fcntl.h>
+#include <stdint.h>
+#include <strings.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <boost/chrono/include.hpp>
+#include <boost/noncopyable.hpp>
+#include "flv_tags.hh"
+
+// An FLV stream ready to be served: a file, or generated bytes in an
+// anonymous memory file, so that both go out through sendfile(). Bytes
+// after the last complete tag are served as they are, after it.
+class FLVSource : private boost::noncopyable {
+public:
+  FLVSource()
+    : _fd(-1)
+    , _size(0) {
+  }
+
+  ~FLVSource() {
+    if (_fd >= 0) {
+      close(_fd);
+    }
+  }
+
+  bool Open(const std::string& path) {
+    _fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (_fd < 0 || fstat(_fd, &st) < 0 || !st.st_size) {
+      return false;
+    }
+    _size = st.st_size;
+    void* data = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+    if (data == MAP_FAILED) {
+      return false;
+    }
+    bool ok = _index.Build(static_cast<const char*>(data), _size);
+    munmap(data, _size);
+    return ok;
+  }
+
+  bool Load(const std::string& bytes) {
+    _fd = memfd_create("flvserve", MFD_CLOEXEC);
+    if (_fd < 0) {
+      return false;
+    }
+    for (size_t done = 0; done < bytes.size(); ) {
+      ssize_t n = write(_fd, bytes.data() + done, bytes.size() - done);
+      if (n <= 0) {
+        return false;
+      }
+      done += n;
+    }
+    _size = bytes.size();
+    return _index.Build(bytes.data(), bytes.size());
+  }
+
+  int Fd() const {
+    return _fd;
+  }
+
+  uint64_t Size() const {
+    return _size;
+  }
+
+  const FLVIndex& Index() const {
+    return _index;
+  }
+
+private:
+  int _fd;
+  uint64_t _size;
+  FLVIndex _index;
+};
+
+// One epoll loop serving a source to every connection it accepts, at the
+// pace of the stream's timestamps or as fast as the socket takes it. Any
+// GET gets the stream: once, with a Content-Length, or looped forever
+// (timestamps starting over) until the viewer closes. Loops of several
+// threads share a port through SO_REUSEPORT; Run() returns after Stop().
+class FLVServer : private boost::noncopyable {
+public:
+  struct Options {
+    Options()
+      : _realtime(false)
+      , _burstMs(0)
+      , _loop(false) {
+    }
+    bool _realtime;
+    uint32_t _burstMs;  // sent at once ahead of the pace
+    bool _loop;
+  };
+
+  static const int PACE_TICK_MS = 100;
+  static const int IDLE_WAIT_MS = 500;
+  static const int MAX_EVENTS = 1024;
+  static const size_t MAX_REQUEST_SIZE = 8192;
+  static const size_t SEND_CHUNK = 1024 * 1024;
+  static const int LISTEN_BACKLOG = 65535;
+
+  FLVServer(const FLVSource& source, const Options& options)
+    : _source(source)
+    , _index(source.Index())
+    , _options(options)
+    , _epollFd(epoll_create1(EPOLL_CLOEXEC))
+    , _listenFd(-1)
+    , _paced(-1)
+    , _nowMs(0)
+    , _nextTick(0)
+    , _open(0)
+    , _accepted(0)
+    , _sent(0)
+    , _stopping(false) {
+    _paced._prev = _paced._next = &_paced;
+    _bodySize = _source.Size() - _index.Start();
+    std::stringstream header;
+    header << "HTTP/1.1 200 OK\r\n"
+           << "Server: flvserve\r\n"
+           << "Content-Type: video/x-flv\r\n";
+    if (_options._loop) {
+      _closeHeader = header.str() + "Connection: close\r\n\r\n";
+      _keepHeader = _closeHeader;
+    } else {
+      header << "Content-Length: " << _source.Size() << "\r\n";
+      _keepHeader = header.str() + "\r\n";
+      _closeHeader = header.str() + "Connection: close\r\n\r\n";
+    }
+  }
+
+  // Connections still open are left to the process' exit.
+  ~FLVServer() {
+    if (_listenFd >= 0) {
+      close(_listenFd);
+    }
+    close(_epollFd);
+  }
+
+  // False with errno set.
+  bool Listen(const std::string& host, uint16_t port) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+      errno = EINVAL;
+      return false;
+    }
+    _listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                       0);
+    int on = 1;
+    if (_listenFd < 0 ||
+        setsockopt(_listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) ||
+        setsockopt(_listenFd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) ||
+        bind(_listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) ||
+        listen(_listenFd, LISTEN_BACKLOG)) {
+      return false;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    return epoll_ctl(_epollFd, EPOLL_CTL_ADD, _listenFd, &ev) == 0;
+  }
+
+  // the port listened on, which Listen() picks when given 0
+  uint16_t Port() const {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    if (getsockname(_listenFd, reinterpret_cast<sockaddr*>(&addr), &len)) {
+      return 0;
+    }
+    return ntohs(addr.sin_port);
+  }
+
+  void Run() {
+    struct epoll_event events[MAX_EVENTS];
+    _nowMs = NowMs();
+    _nextTick = _nowMs + PACE_TICK_MS;
+    while (!__atomic_load_n(&_stopping, __ATOMIC_RELAXED)) {
+      int wait = _paced._next != &_paced ?
+        int(_nextTick > _nowMs ? _nextTick - _nowMs : 0) : IDLE_WAIT_MS;
+      int n = epoll_wait(_epollFd, events, MAX_EVENTS, wait);
+      _nowMs = NowMs();
+      for (int i = 0; i < n; i++) {
+        if (!events[i].data.ptr) {
+          Accept();
+        } else {
+          HandleEvent(static_cast<Connection*>(events[i].data.ptr),
+                      events[i].events);
+        }
+      }
+      if (_nowMs >= _nextTick) {
+        Pace();
+        _nextTick = _nowMs + PACE_TICK_MS;
+      }
+    }
+  }
+
+  // from any thread
+  void Stop() {
+    __atomic_store_n(&_stopping, true, __ATOMIC_RELAXED);
+  }
+
+  // Counters, readable from any thread.
+  size_t Open() const {
+    return __atomic_load_n(&_open, __ATOMIC_RELAXED);
+  }
+
+  uint64_t Accepted() const {
+    return __atomic_load_n(&_accepted, __ATOMIC_RELAXED);
+  }
+
+  uint64_t Sent() const {
+    return __atomic_load_n(&_sent, __ATOMIC_RELAXED);
+  }
+
+private:
+  enum State {
+    STATE_READING,
+    STATE_SENDING
+  };
+
+  struct Connection {
+    explicit Connection(int fd)
+      : _fd(fd)
+      , _state(STATE_READING)
+      , _keepAlive(false)
+      , _head(false)
+      , _blocked(false)
+      , _headerSent(0)
+      , _pos(0)
+      , _startMs(0)
+      , _prev(NULL)
+      , _next(NULL) {
+    }
+    int _fd;
+    uint8_t _state;
+    bool _keepAlive;
+    bool _head;
+    bool _blocked;       // waiting for EPOLLOUT
+    uint32_t _headerSent;
+    uint64_t _pos;       // stream bytes sent for the running request
+    uint64_t _startMs;
+    Connection* _prev;   // listed in _paced while waiting for time
+    Connection* _next;
+    std::string _request;
+  };
+
+  static uint64_t NowMs() {
+    return boost::chrono::duration_cast<boost::chrono::milliseconds>(
+      boost::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  void Add(uint64_t* counter, uint64_t n) {
+    __atomic_store_n(counter, *counter + n, __ATOMIC_RELAXED);
+  }
+
+  void Accept() {
+    for (;;) {
+      int fd = accept4(_listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (fd < 0) {
+        // EAGAIN, or out of descriptors until some close
+        return;
+      }
+      Connection* conn = new Connection(fd);
+      struct epoll_event ev;
+      ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+      ev.data.ptr = conn;
+      if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, fd, &ev)) {
+        close(fd);
+        delete conn;
+        continue;
+      }
+      __atomic_store_n(&_open, _open + 1, __ATOMIC_RELAXED);
+      Add(&_accepted, 1);
+    }
+  }
+
+  void HandleEvent(Connection* conn, uint32_t events) {
+    if (events & (EPOLLERR | EPOLLHUP)) {
+      Close(conn);
+      return;
+    }
+    if ((events & (EPOLLIN | EPOLLRDHUP)) && !Read(conn)) {
+      return;
+    }
+    if ((events & EPOLLOUT) && conn->_blocked) {
+      conn->_blocked = false;
+      Pump(conn);
+    }
+  }
+
+  // False when the connection was closed.
+  bool Read(Connection* conn) {
+    char buf[4096];
+    for (;;) {
+      ssize_t n = recv(conn->_fd, buf, sizeof(buf), 0);
+      if (n > 0) {
+        if (conn->_request.size() + n > MAX_REQUEST_SIZE) {
+          Close(conn);
+          return false;
+        }
+        conn->_request.append(buf, n);
+      } else if (n < 0 && errno == EINTR) {
+        continue;
+      } else if (n < 0 && errno == EAGAIN) {
+        break;
+      } else {
+        Close(conn);
+        return false;
+      }
+    }
+    if (conn->_state == STATE_READING) {
+      return Serve(conn);
+    }
+    return true;
+  }
+
+  // Starts on the first complete request buffered; false when the
+  // connection was closed.
+  bool Serve(Connection* conn) {
+    size_t end = conn->_request.find("\r\n\r\n");
+    if (end == std::string::npos) {
+      return true;
+    }
+    std::string request = conn->_request.substr(0, end + 4);
+    conn->_request.erase(0, end + 4);
+    bool get = request.compare(0, 4, "GET ") == 0;
+    conn->_head = request.compare(0, 5, "HEAD ") == 0;
+    if (!get && !conn->_head) {
+      static const char refused[] =
+        "HTTP/1.1 405 Method Not Allowed\r\n"
+        "Content-Length: 0\r\nConnection: close\r\n\r\n";
+      send(conn->_fd, refused, sizeof(refused) - 1, MSG_NOSIGNAL);
+      Close(conn);
+      return false;
+    }
+    size_t eol = request.find("\r\n");
+    conn->_keepAlive = !_options._loop && eol >= 8 &&
+      request.compare(eol - 8, 8, "HTTP/1.1") == 0 &&
+      !strcasestr(request.c_str(), "\r\nConnection: close");
+    conn->_state = STATE_SENDING;
+    conn->_headerSent = 0;
+    conn->_pos = 0;
+    conn->_startMs = _nowMs;
+    return Pump(conn);
+  }
+
+  // Bytes of the stream due by now.
+  uint64_t Due(const Connection* conn) const {
+    if (!_options._realtime) {
+      return _options._loop ? UINT64_MAX : _source.Size();
+    }
+    uint64_t t = _nowMs - conn->_startMs + _options._burstMs;
+    uint64_t duration = _index.Duration();
+    uint64_t loops = t / duration;
+    if (!_options._loop && loops) {
+      return _source.Size();
+    }
+    return _index.EndAt(t % duration) + loops * _bodySize;
+  }
+
+  // Sends what is due; false when the connection was closed.
+  bool Pump(Connection* conn) {
+    const std::string& header = conn->_keepAlive ? _keepHeader : _closeHeader;
+    while (conn->_headerSent < header.size()) {
+      ssize_t n = send(conn->_fd, header.data() + conn->_headerSent,
+                       header.size() - conn->_headerSent,
+                       MSG_NOSIGNAL | (conn->_head ? 0 : MSG_MORE));
+      if (n < 0) {
+        return Stalled(conn);
+      }
+      conn->_headerSent += n;
+    }
+
+    uint64_t end = conn->_head ? 0 :
+                   _options._loop ? UINT64_MAX : _source.Size();
+    uint64_t due = std::min(Due(conn), end);
+    while (conn->_pos < due) {
+      // the FLV header once, then the tags over and over
+      uint64_t pos = conn->_pos;
+      off_t offset = pos;
+      uint64_t left = _index.Start() - pos;
+      if (pos >= _index.Start()) {
+        uint64_t in = (pos - _index.Start()) % _bodySize;
+        offset = _index.Start() + in;
+        left = _bodySize - in;
+      }
+      size_t chunk = std::min(std::min(due - pos, left),
+                              uint64_t(SEND_CHUNK));
+      ssize_t n = sendfile(conn->_fd, _source.Fd(), &offset, chunk);
+      if (n <= 0) {
+        return n < 0 ? Stalled(conn) : Close(conn);
+      }
+      conn->_pos += n;
+      Add(&_sent, n);
+    }
+
+    if (conn->_pos >= end) {
+      return Finish(conn);
+    }
+    if (!conn->_prev) {
+      Enpace(conn);
+    }
+    return true;
+  }
+
+  // A send that did not go through; false when the connection was closed.
+  bool Stalled(Connection* conn) {
+    if (errno == EAGAIN) {
+      conn->_blocked = true;
+      Unpace(conn);
+      return true;
+    }
+    return Close(conn);
+  }
+
+  // The response is out: keep-alive connections take the next request.
+  bool Finish(Connection* conn) {
+    Unpace(conn);
+    if (!conn->_keepAlive) {
+      return Close(conn);
+    }
+    conn->_state = STATE_READING;
+    return Serve(conn);
+  }
+
+  // Pumping a connection only ever unlists that one.
+  void Pace() {
+    Connection* conn = _paced._next;
+    while (conn != &_paced) {
+      Connection* next = conn->_next;
+      Pump(conn);
+      conn = next;
+    }
+  }
+
+  void Enpace(Connection* conn) {
+    conn->_prev = _paced._prev;
+    conn->_next = &_paced;
+    _paced._prev->_next = conn;
+    _paced._prev = conn;
+  }
+
+  void Unpace(Connection* conn) {
+    if (!conn->_prev) {
+      return;
+    }
+    conn->_prev->_next = conn->_next;
+    conn->_next->_prev = conn->_prev;
+    conn->_prev = conn->_next = NULL;
+  }
+
+  bool Close(Connection* conn) {
+    Unpace(conn);
+    close(conn->_fd);
+    delete conn;
+    __atomic_store_n(&_open, _open - 1, __ATOMIC_RELAXED);
+    return false;
+  }
+
+  const FLVSource& _source;
+  const FLVIndex& _index;
+  Options _options;
+  uint64_t _bodySize;
+  std::string _keepHeader;
+  std::string _closeHeader;
+  int _epollFd;
+  int _listenFd;
+  Connection _paced;  // head of the list of connections waiting for time
+  uint64_t _nowMs;
+  uint64_t _nextTick;
+  size_t _open;
+  uint64_t _accepted;
+  uint64_t _sent;
+  bool _stopping;
+};
+
+#endif // FLV_SERVER_HH_INCLUDED
@@ -0,0 +1,150 @@
+#ifndef FLV_TAGS_HH_INCLUDED
+#define FLV_TAGS_HH_INCLUDED
+
+#include <algorithm>
+#include <vector>
+#include <stdint.h>
+
+// FLV framing: a 9 byte file header and a 4 byte zero, then tags of an
+// 11 byte header (type, 24 bit body size, 24+8 bit timestamp in ms,
+// stream id), the body, and a 4 byte size of the tag just ended.
+namespace flv {
+
+static const uint32_t FILE_HEADER_SIZE = 9;
+static const uint32_t TAG_HEADER_SIZE = 11;
+static const uint32_t PREV_SIZE_SIZE = 4;
+static const uint32_t MAX_BODY_SIZE = 0xffffff;
+
+enum TagType {
+  TAG_AUDIO = 8,
+  TAG_VIDEO = 9,
+  TAG_SCRIPT = 18
+};
+
+inline uint32_t GetBE24(const unsigned char* p) {
+  return (uint32_t(p[0]) << 16) | (uint32_t(p[1]) << 8) | p[2];
+}
+
+inline void PutBE24(unsigned char* p, uint32_t value) {
+  p[0] = value >> 16;
+  p[1] = value >> 8;
+  p[2] = value;
+}
+
+inline void PutBE32(unsigned char* p, uint32_t value) {
+  p[0] = value >> 24;
+  PutBE24(p + 1, value);
+}
+
+} // namespace flv
+
+// Where every tag of an FLV stream ends and when it plays, for serving
+// the stream at the pace of its timestamps. Offsets are from the start
+// of the stream; the first tag starts at Start().
+class FLVIndex {
+public:
+  struct Tag {
+    uint32_t _time;  // ms
+    uint8_t _type;
+    uint64_t _end;   // one past the tag's trailing size
+  };
+
+  FLVIndex()
+    : _start(0)
+    , _broken(false) {
+  }
+
+  // Takes the tags up to the first that is cut short or malformed; false
+  // when there is no FLV header or not one complete tag.
+  bool Build(const char* data, size_t size) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    _tags.clear();
+    _broken = false;
+    if (size < flv::FILE_HEADER_SIZE + flv::PREV_SIZE_SIZE ||
+        p[0] != 'F' || p[1] != 'L' || p[2] != 'V') {
+      return false;
+    }
+    uint32_t headerSize = (uint32_t(p[5]) << 24) | flv::GetBE24(p + 6);
+    _start = uint64_t(headerSize) + flv::PREV_SIZE_SIZE;
+    uint64_t pos = _start;
+    while (pos + flv::TAG_HEADER_SIZE <= size) {
+      const unsigned char* tag = p + pos;
+      uint8_t type = tag[0] & 0x1f;
+      uint64_t end = pos + flv::TAG_HEADER_SIZE + flv::GetBE24(tag + 1) +
+                     flv::PREV_SIZE_SIZE;
+      if ((type != flv::TAG_AUDIO && type != flv::TAG_VIDEO &&
+           type != flv::TAG_SCRIPT) || end > size) {
+        _broken = true;
+        break;
+      }
+      Tag t;
+      t._time = flv::GetBE24(tag + 4) | (uint32_t(tag[7]) << 24);
+      t._type = type;
+      t._end = end;
+      _tags.push_back(t);
+      pos = end;
+    }
+    _broken = _broken || pos != size;
+    return !_tags.empty();
+  }
+
+  uint64_t Start() const {
+    return _start;
+  }
+
+  // end of the last complete tag
+  uint64_t End() const {
+    return _tags.empty() ? _start : _tags.back()._end;
+  }
+
+  size_t Count() const {
+    return _tags.size();
+  }
+
+  const Tag& operator[](size_t i) const {
+    return _tags[i];
+  }
+
+  // trailing bytes or a bad tag were left out
+  bool Broken() const {
+    return _broken;
+  }
+
+  // Play time of the whole stream: the last timestamp plus the gap before
+  // it, so that a looped stream keeps its pace.
+  uint32_t Duration() const {
+    if (_tags.empty()) {
+      return 1;
+    }
+    uint32_t last = _tags.back()._time;
+    uint32_t gap = 1;
+    for (size_t i = _tags.size() - 1; i-- > 0; ) {
+      if (_tags[i]._time < last) {
+        gap = last - _tags[i]._time;
+        break;
+      }
+    }
+    return last + gap;
+  }
+
+  // End of the last tag due at time ms (Start() when none is), assuming
+  // timestamps do not go back.
+  uint64_t EndAt(uint32_t ms) const {
+    std::vector<Tag>::const_iterator it =
+      std::upper_bound(_tags.begin(), _tags.end(), ms, LaterThan());
+    return it == _tags.begin() ? _start : (it - 1)->_end;
+  }
+
+private:
+  struct LaterThan {
+    bool operator()(uint32_t ms, const Tag& tag) const {
+      return ms < tag._time;
+    }
+  };
+
+  uint64_t _start;
+  bool _broken;
+  std::vector<Tag> _tags;
+};
+
+#endif // FLV_TAGS_HH_INCLUDED
@@ -0,0 +1,156 @@
+#include <csignal>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <boost/bind.hpp>
+#include <boost/chrono/include.hpp>
+#include <boost/program_options.hpp>
+#include <boost/smart_ptr.hpp>
+#include <boost/thread.hpp>
+#include "flv_generator.hh"
+#include "flv_server.hh"
+
+using namespace boost::program_options;
+
+// Local origin for benchmarking perftest: serves an FLV file or a
+// generated stream on every GET, paced or not, until SIGINT/SIGTERM.
+int main(int argc, char* argv[])
+{
+  options_description opt;
+  opt.add_options()
+    ("port,p", value<uint16_t>()->default_value(8092), "listening port")
+    ("bind,b", value<std::string>()->default_value("0.0.0.0"), "listening address")
+    ("file,f", value<std::string>(), "flv file to serve")
+    ("generate,g", value<std::string>(), "serve a generated stream (video=kbps,fps=n,gop=ms,key=factor,audio=kbps,aframe=ms,seconds=n,seed=n,gaps=n,gap=ms,jumps=n,jump=ms,truncate=1)")
+    ("realtime,r", "pace the stream by its timestamps")
+    ("burst", value<uint32_t>(), "milliseconds of stream sent at once ahead of the pace")
+    ("loop,l", "repeat the stream until the viewer leaves")
+    ("threads,t", value<size_t>()->default_value(1), "serving threads")
+    ("quiet,q", "no status line every second");
+
+  variables_map vmap;
+  try {
+    store(parse_command_line(argc, argv, opt), vmap);
+    notify(vmap);
+  } catch (std::exception& ex) {
+    std::cout << "flvserve [OPTION]...\n" << opt << std::endl;
+    return 1;
+  }
+
+  FLVSource source;
+  std::string what;
+  if (vmap.count("file")) {
+    what = vmap["file"].as<std::string>();
+    if (!source.Open(what)) {
+      std::cout << "can not serve " << what << ": not an flv file\n";
+      return 1;
+    }
+  } else {
+    FLVGenerator generator;
+    if (vmap.count("generate") &&
+        !generator.Parse(vmap["generate"].as<std::string>())) {
+      std::cout << "bad stream: " << vmap["generate"].as<std::string>()
+                << "\n";
+      return 1;
+    }
+    what = generator.Describe();
+    if (!source.Load(generator.Generate())) {
+      std::cout << "can not generate the stream (" << strerror(errno)
+                << ")\n";
+      return 1;
+    }
+  }
+  if (source.Index().Broken()) {
+    std::cout << source.Size() - source.Index().End()
+              << " bytes after the last complete tag, served as they are\n";
+  }
+
+  FLVServer::Options options;
+  options._realtime = vmap.count("realtime");
+  options._loop = vmap.count("loop");
+  if (vmap.count("burst")) {
+    options._burstMs = vmap["burst"].as<uint32_t>();
+  }
+
+  // as many connections as the hard limit allows
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+  signal(SIGPIPE, SIG_IGN);
+  // taken below by the main thread only
+  sigset_t quit;
+  sigemptyset(&quit);
+  sigaddset(&quit, SIGINT);
+  sigaddset(&quit, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &quit, NULL);
+
+  std::string host = vmap["bind"].as<std::string>();
+  uint16_t port = vmap["port"].as<uint16_t>();
+  size_t threads = std::max(vmap["threads"].as<size_t>(), size_t(1));
+  std::vector<boost::shared_ptr<FLVServer> > servers;
+  for (size_t i = 0; i < threads; i++) {
+    boost::shared_ptr<FLVServer> server(new FLVServer(source, options));
+    if (!server->Listen(host, port)) {
+      std::cout << "can not listen on " << host << ":" << port << " ("
+                << strerror(errno) << ")\n";
+      return 1;
+    }
+    servers.push_back(server);
+  }
+
+  const FLVIndex& index = source.Index();
+  std::cout << "serving " << what << " (" << source.Size() << " bytes, "
+            << index.Count() << " tags, " << index.Duration() << " ms) on "
+            << host << ":" << port << ", "
+            << (options._realtime ? "real-time" : "unthrottled")
+            << (options._loop ? ", looped" : "") << ", " << threads
+            << " threads" << std::endl;
+
+  boost::thread_group group;
+  for (size_t i = 0; i < servers.size(); i++) {
+    group.create_thread(boost::bind(&FLVServer::Run, servers[i].get()));
+  }
+
+  boost::chrono::steady_clock::time_point start =
+    boost::chrono::steady_clock::now();
+  uint64_t lastSent = 0;
+  for (;;) {
+    struct timespec timeout = { 1, 0 };
+    if (sigtimedwait(&quit, NULL, &timeout) > 0) {
+      break;
+    }
+    if (vmap.count("quiet")) {
+      continue;
+    }
+    size_t open = 0;
+    uint64_t accepted = 0, sent = 0;
+    for (size_t i = 0; i < servers.size(); i++) {
+      open += servers[i]->Open();
+      accepted += servers[i]->Accepted();
+      sent += servers[i]->Sent();
+    }
+    std::stringstream rate;
+    rate.setf(std::ios::fixed);
+    rate.precision(1);
+    rate << (sent - lastSent) * 8 / 1e6;
+    lastSent = sent;
+    std::cout << "[" << int(boost::chrono::duration<double>(
+                   boost::chrono::steady_clock::now() - start).count())
+              << "s]  connections: " << open
+              << "  accepted: " << accepted
+              << "  sent: " << rate.str() << " (Mbit/s)" << std::endl;
+  }
+
+  for (size_t i = 0; i < servers.size(); i++) {
+    servers[i]->Stop();
+  }
+  group.join_all();
+  return 0;
+}
@@ -0,0 +1,147 @@
+#ifndef HAPPY_EYEBALLS_HH_INCLUDED
+#define HAPPY_EYEBALLS_HH_INCLUDED
+
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/chrono/include.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/smart_ptr.hpp>
+
+using boost::asio::ip::tcp;
+
+// Staggered parallel connect across resolved endpoints (RFC 8305). The
+// endpoints are interleaved by address family, a new attempt starts every
+// ATTEMPT_DELAY_MS or as soon as the previous one fails, and the first
+// socket to connect wins while the others are closed. Pending handlers
+// hold a reference, so the racer outlives its owner when cancelled.
+class HappyEyeballs : public boost::enable_shared_from_this<HappyEyeballs>
+                    , private boost::noncopyable {
+public:
+  static const int ATTEMPT_DELAY_MS = 250;
+
+  // Called once, with the connected socket to take over on success; not
+  // called at all after Cancel().
+  typedef boost::function<void (const boost::system::error_code&,
+                                tcp::socket&)> Handler;
+
+  explicit HappyEyeballs(boost::asio::io_service& ioServ)
+    : _ioServ(ioServ)
+    , _timer(ioServ)
+    , _next(0)
+    , _failed(0)
+    , _done(false) {
+  }
+
+  void Start(tcp::resolver::iterator it, const Handler& handler) {
+    _handler = handler;
+    std::vector<tcp::endpoint> first, second;
+    for (; it != tcp::resolver::iterator(); ++it) {
+      tcp::endpoint endpoint = *it;
+      if (first.empty() ||
+          first.front().address().is_v6() == endpoint.address().is_v6()) {
+        first.push_back(endpoint);
+      } else {
+        second.push_back(endpoint);
+      }
+    }
+    // the family listed first by the resolver leads, then alternate
+    for (size_t i = 0; i < first.size() || i < second.size(); i++) {
+      if (i < first.size()) _endpoints.push_back(first[i]);
+      if (i < second.size()) _endpoints.push_back(second[i]);
+    }
+    StartAttempt();
+  }
+
+  void Start(const tcp::endpoint& endpoint, const Handler& handler) {
+    _handler = handler;
+    _endpoints.push_back(endpoint);
+    StartAttempt();
+  }
+
+  void Cancel() {
+    if (_done) {
+      return;
+    }
+    _done = true;
+    CloseAll();
+  }
+
+private:
+  typedef boost::asio::basic_waitable_timer<
+    boost::chrono::steady_clock> steady_timer;
+
+  void StartAttempt() {
+    if (_next >= _endpoints.size()) {
+      return;
+    }
+    size_t index = _next++;
+    _sockets.push_back(boost::shared_ptr<tcp::socket>(new tcp::socket(_ioServ)));
+    _sockets.back()->async_connect(_endpoints[index],
+      boost::bind(&HappyEyeballs::HandleConnect, shared_from_this(),
+        boost::asio::placeholders::error, index));
+
+    if (_next < _endpoints.size()) {
+      _timer.expires_from_now(
+        boost::chrono::milliseconds(ATTEMPT_DELAY_MS));
+      _timer.async_wait(boost::bind(&HappyEyeballs::HandleDelay,
+        shared_from_this(), boost::asio::placeholders::error));
+    }
+  }
+
+  void HandleDelay(const boost::system::error_code& err) {
+    if (!err && !_done) {
+      StartAttempt();
+    }
+  }
+
+  void HandleConnect(const boost::system::error_code& err, size_t index) {
+    if (_done) {
+      return;
+    }
+    if (!err) {
+      _done = true;
+      tcp::socket& winner = *_sockets[index];
+      for (size_t i = 0; i < _sockets.size(); i++) {
+        if (i != index && _sockets[i]->is_open()) {
+          _sockets[i]->close();
+        }
+      }
+      _timer.cancel();
+      _handler(err, winner);
+      return;
+    }
+
+    _sockets[index]->close();
+    if (++_failed == _endpoints.size()) {
+      _done = true;
+      _handler(err, *_sockets[index]);
+    } else {
+      // a failed attempt hands its turn over without waiting the delay
+      _timer.cancel();
+      StartAttempt();
+    }
+  }
+
+  void CloseAll() {
+    _timer.cancel();
+    for (size_t i = 0; i < _sockets.size(); i++) {
+      if (_sockets[i]->is_open()) {
+        _sockets[i]->close();
+      }
+    }
+  }
+
+  boost::asio::io_service& _ioServ;
+  steady_timer _timer;
+  Handler _handler;
+  std::vector<tcp::endpoint> _endpoints;
+  std::vector<boost::shared_ptr<tcp::socket> > _sockets;
+  size_t _next;
+  size_t _failed;
+  bool _done;
+};
+
+#endif // HAPPY_EYEBALLS_HH_INCLUDED
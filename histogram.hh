@@ -0,0 +1,97 @@
+#ifndef HISTOGRAM_HH_INCLUDED
+#define HISTOGRAM_HH_INCLUDED
+
+#include <cstring>
+#include <stdint.h>
+
+// Log-linear histogram of non-negative integer samples (milliseconds in
+// practice). Values below 2^SUB_BITS+1 are exact, larger ones fall in one
+// of 2^SUB_BITS buckets per power of two, i.e. within ~6% of the truth.
+// Fixed size and plain counters, so histograms merge by adding buckets.
+class Histogram {
+public:
+  static const uint32_t SUB_BITS = 4;
+  static const uint32_t SUB_COUNT = 1 << SUB_BITS;
+  static const uint32_t LINEAR_COUNT = SUB_COUNT * 2;
+  static const uint32_t BUCKETS =
+    LINEAR_COUNT + (31 - SUB_BITS - 1) * SUB_COUNT;
+
+  Histogram()
+    : _total(0) {
+    memset(_counts, 0, sizeof(_counts));
+  }
+
+  void Add(int32_t value) {
+    _counts[Index(value < 0 ? 0 : uint32_t(value))]++;
+    _total++;
+  }
+
+  void Merge(const Histogram& other) {
+    for (uint32_t i = 0; i < BUCKETS; i++) {
+      _counts[i] += other._counts[i];
+    }
+    _total += other._total;
+  }
+
+  uint64_t Count() const {
+    return _total;
+  }
+
+  // Raw buckets, for shipping histograms around.
+  uint32_t Bucket(uint32_t index) const {
+    return _counts[index];
+  }
+
+  void AddToBucket(uint32_t index, uint32_t count) {
+    _counts[index] += count;
+    _total += count;
+  }
+
+  // Upper bound of the bucket holding the given quantile (0..1), -1 when
+  // no sample was added.
+  int64_t Percentile(double q) const {
+    if (!_total) {
+      return -1;
+    }
+    uint64_t rank = uint64_t(q * _total + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > _total) rank = _total;
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < BUCKETS; i++) {
+      seen += _counts[i];
+      if (seen >= rank) {
+        return UpperBound(i);
+      }
+    }
+    return UpperBound(BUCKETS - 1);
+  }
+
+private:
+  static uint32_t Msb(uint32_t v) {
+    return 31 - __builtin_clz(v);
+  }
+
+  static uint32_t Index(uint32_t v) {
+    if (v < LINEAR_COUNT) {
+      return v;
+    }
+    uint32_t msb = Msb(v);
+    return LINEAR_COUNT + (msb - SUB_BITS - 1) * SUB_COUNT +
+           ((v >> (msb - SUB_BITS)) & (SUB_COUNT - 1));
+  }
+
+  static int64_t UpperBound(uint32_t index) {
+    if (index < LINEAR_COUNT) {
+      return index;
+    }
+    uint32_t msb = (index - LINEAR_COUNT) / SUB_COUNT + SUB_BITS + 1;
+    uint32_t sub = (index - LINEAR_COUNT) % SUB_COUNT;
+    int64_t width = int64_t(1) << (msb - SUB_BITS);
+    return (int64_t(1) << msb) + (sub + 1) * width - 1;
+  }
+
+  uint32_t _counts[BUCKETS];
+  uint64_t _total;
+};
+
+#endif // HISTOGRAM_HH_INCLUDED
@@ -1,6 +1,7 @@
 #ifndef HTTP_PLAYSESSION_HH_INCLUDED
 #define HTTP_PLAYSESSION_HH_INCLUDED
 
+#include <cstring>
 #include <iostream>
 #include <istream>
 #include <ostream>
@@ -9,15 +10,92 @@
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
 #include <boost/chrono/include.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/scoped_ptr.hpp>
+#include "chunked_decoder.hh"
+#include "happy_eyeballs.hh"
+#include "http_request.hh"
+#include "http_response_parser.hh"
 #include "play_session.hh"
+#include "resolve_cache.hh"
+#include "timing_wheel.hh"
+#include "uring_reactor.hh"
 #include "url.hpp"
 
 using boost::asio::ip::tcp;
 
-class HTTPPlaySession : public PlaySession {
+// What every session of a run shares, kept once by the arena instead of
+// in each session: the observer, the reactor, the timing wheel, the
+// lookup service and the receive options. It also keeps the books on
+// the memory the sessions hold, see HTTPPlaySession::Footprint().
+struct HTTPSessionContext {
+  HTTPSessionContext(PlaySession::Observable* observer,
+                     boost::asio::io_service& ioServ,
+                     TimingWheel& wheel,
+                     tcp::resolver& resolver)
+    : _observer(observer)
+    , _ioServ(ioServ)
+    , _wheel(wheel)
+    , _resolver(resolver)
+    , _uring(NULL)
+    , _dns(NULL)
+    , _timeout(10)
+    , _requests(1)
+    , _drain(false)
+    , _pipeline(false)
+    , _live(0)
+    , _maxLive(0)
+    , _bytes(0)
+    , _peakBytes(0)
+    , _liveAtPeak(0) {
+  }
+
+  void AddSession() {
+    _maxLive = std::max(_maxLive, ++_live);
+  }
+
+  void RemoveSession() {
+    _live--;
+  }
+
+  void Account(int64_t delta) {
+    _bytes += delta;
+    if (_bytes > _peakBytes) {
+      _peakBytes = _bytes;
+      _liveAtPeak = _live;
+    }
+  }
+
+  PlaySession::Observable* _observer;
+  boost::asio::io_service& _ioServ;
+  TimingWheel& _wheel;
+  tcp::resolver& _resolver;
+  UringReactor* _uring;
+  ResolveCache* _dns;
+  int32_t _timeout;
+  uint32_t _requests;
+  bool _drain;
+  bool _pipeline;
+  size_t _live;
+  size_t _maxLive;
+  size_t _bytes;
+  size_t _peakBytes;
+  size_t _liveAtPeak;  // sessions running at _peakBytes
+};
+
+class HTTPPlaySession : public PlaySession
+                      , public TimingWheel::Entry
+                      , public UringReactor::Receiver
+                      , public boost::enable_shared_from_this<HTTPPlaySession> {
 public:
   static const int RECV_BLOCK_SIZE = 10 * 1024;
   static const int STATS_WINDOW_SIZE = 1024 * 1024;
+  static const int DRAIN_BLOCK_SIZE = 64 * 1024;
+  // most a drain wakeup reads before yielding to other sessions
+  static const size_t DRAIN_WAKEUP_SIZE = 4 * DRAIN_BLOCK_SIZE;
+  static const int HEADER_BLOCK_SIZE = 2 * 1024;
+  static const size_t FIRST_CHUNK_SIZE = 16;
 
   enum HTTPErrorCode {
     ERROR_BASE = HTTP_ERROR_BASE,
@@ -28,33 +106,55 @@ public:
     ERROR_BAD_HTTP,
     ERROR_TIMEOUT_FOR_NO_DATA,
     ERROR_EARLY_EOF,
+    ERROR_BAD_CHUNKED,
+    ERROR_TRUNCATED_BODY,
+    ERROR_CLOSED_EARLY,
     ERROR_MAX
   };
 
-  HTTPPlaySession(Observable* obs,
-                  boost::asio::io_service& ioServ,
-                  const boost::shared_ptr<Summary>& sum,
-                  const urdl::url& url,
-                  int32_t timeout)
-      : _observer(obs)
-      , _resolver(ioServ)
-      , _socket(ioServ)
-      , _timer(ioServ)
-      , _sum(sum)
+  HTTPPlaySession(HTTPSessionContext& context,
+                  size_t urlId,
+                  const RequestBuffer& request)
+      : _context(context)
+      , _request(request)
+      , _socket(context._ioServ)
       , _contentBytes(0)
+      , _byteLimit(~size_t(0))
+      , _overheadBytes(0)
+      , _lastActive(0)
+      , _watchEnd(0)
+      , _uringToken(0)
+      , _bodyRemaining(-1)
+      , _urlId(urlId)
+      , _edgeId(-1)
+      , _resolveMs(-1)
       , _statsBytes(0)
-      , _timeout(timeout)
-      , _url(url.to_string()) {
-    std::ostream request_stream(&_request);
-    std::string path = url.query().empty() ?
-                         url.path() : url.path() + "?" + url.query();
-    request_stream << "GET " << path << " HTTP/1.1\r\n";
-    request_stream << "User-Agent: "
-                   << "Mozilla/5.0 (Windows NT 6.1; WOW64)\r\n";
-    request_stream << "Host: " << url.host() << "\r\n";
-    request_stream << "Accept: */*\r\n";
-    request_stream << "Connection: keep-alive\r\n\r\n";
+      , _stallTicks(0)
+      , _blockSize(0)
+      , _accounted(0)
+      , _responses(0)
+      , _bodyEnd(ChunkedDecoder::NEED_MORE)
+      , _endError(ERROR_BASE)
+      , _receiving(false)
+      , _uringArmed(false)
+      , _uringOff(false)
+      , _nextHeader(false)
+      , _chunkedBody(false)
+      , _lastResponse(false) {
+    _context.AddSession();
+    Account();
+  }
 
+  virtual ~HTTPPlaySession() {
+    _context.Account(-int64_t(_accounted));
+    _context.RemoveSession();
+  }
+
+  // Pending handlers own the session, so it lives until the last of them
+  // has run after Disconnect().
+  virtual void Start(const urdl::url& url) {
+    _connector.reset(new HappyEyeballs(_context._ioServ));
+    Account();
     boost::system::error_code ec;
     boost::asio::ip::address addr =
       boost::asio::ip::address::from_string(url.host().c_str(), ec);
@@ -62,264 +162,699 @@ public:
       tcp::endpoint endpoint = tcp::endpoint(addr,
         url.port() ? url.port() : 80);
       _checkPoint = boost::chrono::system_clock::now();
-      _socket.async_connect(endpoint,
-        boost::bind(&HTTPPlaySession::HandleConnectIP, this,
-          boost::asio::placeholders::error));
-
+      _connector->Start(endpoint, ConnectHandler());
       return;
     }
 
-    tcp::resolver::query query(url.host(), url.protocol());
+    // resolve the port of the URL, not the default one of its scheme
+    uint16_t port = url.port() ? url.port() : 80;
+    std::string key;
+    if (_context._dns) {
+      key = ResolveCache::Key(url.host(), port);
+      tcp::resolver::iterator it;
+      if (_context._dns->Find(key, &it)) {
+        _checkPoint = boost::chrono::system_clock::now();
+        _connector->Start(it, ConnectHandler());
+        return;
+      }
+    }
+    tcp::resolver::query query(url.host(),
+      boost::lexical_cast<std::string>(port),
+      tcp::resolver::query::numeric_service);
     _checkPoint = boost::chrono::system_clock::now();
-    _resolver.async_resolve(query,
-      boost::bind(&HTTPPlaySession::HandleResolve, this,
+    _context._resolver.async_resolve(query,
+      boost::bind(&HTTPPlaySession::HandleResolve, shared_from_this(),
         boost::asio::placeholders::error,
-        boost::asio::placeholders::iterator));
+        boost::asio::placeholders::iterator, key));
   }
 
+  // A lookup in flight can not be cancelled on the shared resolver, its
+  // result is dropped when it comes.
   virtual void Disconnect() {
+    if (_connector) {
+      _connector->Cancel();
+      _connector.reset();
+    }
+    if (_uringArmed) {
+      _context._uring->Cancel(_uringToken);
+      _uringArmed = false;
+    }
     if (_socket.is_open()) {
       _socket.close();
     }
-    _timer.cancel();
+    _context._wheel.Remove(this);
+  }
+
+  virtual void FlushStats() {
+    if (!_statsBytes) {
+      return;
+    }
+    boost::chrono::milliseconds duration =
+      boost::chrono::duration_cast<boost::chrono::milliseconds>(
+        boost::chrono::system_clock::now() - _checkPoint);
+
+    _context._observer->OnContent(this, _statsBytes,
+                                  std::max(1LL, (long long)duration.count()));
+
+    _checkPoint = boost::chrono::system_clock::now();
+    _statsBytes = 0;
+  }
+
+  virtual size_t GetURLId() const {
+    return _urlId;
+  }
+
+  virtual void SetByteLimit(size_t bytes) {
+    _byteLimit = bytes;
+  }
+
+  virtual size_t ByteLimit() const {
+    return _byteLimit;
+  }
+
+  virtual void SetStallTime(int32_t ms) {
+    _stallTicks = ms > 0 ? uint32_t(TimingWheel::MillisToTicks(ms)) : 0;
+  }
+
+  virtual void SetWatchTime(int32_t ms) {
+    _watchEnd = _context._wheel.Now() +
+                std::max(TimingWheel::MillisToTicks(ms), uint64_t(1));
+    ScheduleTimer();
+  }
+
+  virtual size_t PayloadBytes() const {
+    return _contentBytes;
+  }
+
+  virtual size_t OverheadBytes() const {
+    return _overheadBytes;
   }
 
-  virtual std::string GetPlayURL() const {
-    return _url;
+  virtual const tcp::endpoint& RemoteEndpoint() const {
+    return _remote;
   }
 
-  const boost::shared_ptr<Summary>& GetSummary() const {
-    return _sum;
+  virtual int32_t ResolveMillis() const {
+    return _resolveMs;
+  }
+
+  virtual int32_t GetEdgeId() const {
+    return _edgeId;
+  }
+
+  virtual void SetEdgeId(int32_t id) {
+    _edgeId = id;
+  }
+
+  // Heap and object bytes the session holds now: itself, its receive
+  // block, and the parser and connector while it has them. Kernel socket
+  // buffers and the reactor's own state are not included.
+  size_t Footprint() const {
+    return sizeof(*this) + _blockSize +
+           (_parser ? sizeof(HTTPResponseParser) : 0) +
+           (_connector ? sizeof(HappyEyeballs) : 0);
   }
 
 protected:
 
+  // key is set when the lookup goes into the shared cache
   void HandleResolve(const boost::system::error_code& err,
-                     tcp::resolver::iterator endpoint_iterator) {
+                     tcp::resolver::iterator endpoint_iterator,
+                     const std::string& key) {
+    if (!_connector) {
+      return;
+    }
     if (!err) {
+      if (_context._dns) {
+        _context._dns->Insert(key, endpoint_iterator);
+      }
       boost::chrono::milliseconds elapsed =
         boost::chrono::duration_cast<boost::chrono::milliseconds>(
           boost::chrono::system_clock::now() - _checkPoint);
-      _observer->OnResolved(this, elapsed.count());
+      _resolveMs = elapsed.count();
+      _context._observer->OnResolved(this, elapsed.count());
       _checkPoint = boost::chrono::system_clock::now();
 
-      tcp::endpoint endpoint = *endpoint_iterator;
-      _socket.async_connect(endpoint,
-        boost::bind(&HTTPPlaySession::HandleConnect, this,
-          boost::asio::placeholders::error, ++endpoint_iterator));
-    } else if (_socket.is_open()) {
-      _observer->OnError(this, ERROR_ON_RESOLVE);
+      _connector->Start(endpoint_iterator, ConnectHandler());
+    } else {
+      _context._observer->OnError(this, ERROR_ON_RESOLVE);
     }
   }
 
-  void HandleConnectIP(const boost::system::error_code& err) {
+  HappyEyeballs::Handler ConnectHandler() {
+    return boost::bind(&HTTPPlaySession::HandleConnect, shared_from_this(),
+                       _1, _2);
+  }
+
+  // The connector only calls back while not cancelled, the winning
+  // socket is moved into the session.
+  void HandleConnect(const boost::system::error_code& err,
+                     tcp::socket& socket) {
+    _connector.reset();
+    Account();
     if (!err) {
       boost::chrono::milliseconds elapsed =
         boost::chrono::duration_cast<boost::chrono::milliseconds>(
           boost::chrono::system_clock::now() - _checkPoint);
-      _observer->OnConnected(this, elapsed.count());
+      boost::system::error_code ec;
+      _socket = std::move(socket);
+      _remote = _socket.remote_endpoint(ec);
+      _context._observer->OnConnected(this, elapsed.count());
       _checkPoint = boost::chrono::system_clock::now();
 
-      boost::asio::async_write(_socket, _request,
-        boost::bind(&HTTPPlaySession::HandleRequest, this,
-          boost::asio::placeholders::error));
+      WriteRequest();
 
-    } else if (_socket.is_open()) {
-      _observer->OnError(this, ERROR_ON_CONNECT);
+    } else {
+      _context._observer->OnError(this, ERROR_ON_CONNECT);
     }
   }
 
-  void HandleConnect(const boost::system::error_code& err,
-                     tcp::resolver::iterator endpoint_iterator) {
-    if (!err) {
-      boost::chrono::milliseconds elapsed =
-        boost::chrono::duration_cast<boost::chrono::milliseconds>(
-          boost::chrono::system_clock::now() - _checkPoint);
-      _observer->OnConnected(this, elapsed.count());
-
-      boost::asio::async_write(_socket, _request,
-        boost::bind(&HTTPPlaySession::HandleRequest, this,
-          boost::asio::placeholders::error));
-
-    } else if (endpoint_iterator != tcp::resolver::iterator()) {
-      _socket.close();
+  // Pipelining puts every request of the connection on the wire at once,
+  // all pointing at the same shared request bytes.
+  void WriteRequest() {
+    _requestStart = boost::chrono::system_clock::now();
+    _downloadStart = _requestStart;
+    std::vector<boost::asio::const_buffer> buffers(
+      _context._pipeline ? _context._requests : 1,
+      boost::asio::buffer(*_request));
+    boost::asio::async_write(_socket, buffers,
+      boost::bind(&HTTPPlaySession::HandleRequest, shared_from_this(),
+        boost::asio::placeholders::error));
+  }
 
-      tcp::endpoint endpoint = *endpoint_iterator;
-      _socket.async_connect(endpoint,
-        boost::bind(&HTTPPlaySession::HandleConnect, this,
-          boost::asio::placeholders::error, ++endpoint_iterator));
+  void WriteNextRequest() {
+    _requestStart = boost::chrono::system_clock::now();
+    boost::asio::async_write(_socket, boost::asio::buffer(*_request),
+      boost::bind(&HTTPPlaySession::HandleNextRequest, shared_from_this(),
+        boost::asio::placeholders::error));
+  }
 
-    } else if (_socket.is_open()) {
-      _observer->OnError(this, ERROR_ON_CONNECT);
+  void HandleNextRequest(const boost::system::error_code& err) {
+    if (err && _socket.is_open()) {
+      _context._observer->OnError(this, ERROR_ON_REQUEST);
     }
   }
 
   void HandleRequest(const boost::system::error_code& err) {
     if (!err) {
       _checkPoint = boost::chrono::system_clock::now();
-      _timer.expires_from_now(boost::posix_time::seconds(_timeout));
-      _timer.async_wait(boost::bind(&HTTPPlaySession::HandleTimeout, this, _contentBytes));
+      _lastActive = _context._wheel.Now();
+      _receiving = true;
+      ScheduleTimer();
 
-      boost::asio::async_read_until(_socket, _response, "\r\n\r\n",
-        boost::bind(&HTTPPlaySession::HandleRecvHeader, this,
-          boost::asio::placeholders::error));
+      _parser.reset(new HTTPResponseParser());
+      ResizeBlock(HEADER_BLOCK_SIZE);
+      ReadHeader();
 
     } else if (_socket.is_open()) {
-      _observer->OnError(this, ERROR_ON_REQUEST);
+      _context._observer->OnError(this, ERROR_ON_REQUEST);
     }
   }
 
-  void HandleRecvHeader(const boost::system::error_code& err) {
+  // The parser takes the head as it comes, so every read may reuse the
+  // block from its start.
+  void ReadHeader() {
+    _socket.async_read_some(boost::asio::buffer(_block.get(), _blockSize),
+      boost::bind(&HTTPPlaySession::HandleRecvHeader, shared_from_this(),
+        boost::asio::placeholders::error,
+        boost::asio::placeholders::bytes_transferred));
+  }
+
+  void HandleRecvHeader(const boost::system::error_code& err,
+                        size_t bytes) {
     if (!err) {
-      std::istream stream(&_response);
-      std::string httpVersion;
-      stream >> httpVersion;
-      uint32_t statusCode;
-      stream >> statusCode;
+      size_t used;
+      HTTPResponseParser::Result res = _parser->Feed(_block.get(), bytes,
+                                                     &used);
+      if (res == HTTPResponseParser::NEED_MORE) {
+        ReadHeader();
+        return;
+      }
 
       boost::chrono::milliseconds elapsed =
         boost::chrono::duration_cast<boost::chrono::milliseconds>(
           boost::chrono::system_clock::now() - _checkPoint);
-      _observer->OnRecvHeader(this, elapsed.count());
+      _context._observer->OnRecvHeader(this, elapsed.count());
 
-      if (!stream || httpVersion.substr(0, 5) != "HTTP/") {
-        _observer->OnError(this, ERROR_BAD_HTTP);
+      if (res == HTTPResponseParser::BAD) {
+        _context._observer->OnError(this, ERROR_BAD_HTTP);
         return;
       }
+      _context._observer->OnResponseHeader(this, *_parser);
 
-      if (statusCode != 200) {
-        std::cout << "http resp code: " << statusCode << std::endl;
-        _observer->OnError(this, ERROR_BAD_HTTP);
+      if (!Acceptable(*_parser)) {
+        std::cout << "http resp code: " << _parser->StatusCode() << std::endl;
+        _context._observer->OnError(this, ERROR_BAD_HTTP);
         return;
       }
 
-      size_t blocksize = _response.size();
-      _response.consume(blocksize);
-
-      boost::asio::async_read(_socket, _response,
-        boost::asio::transfer_exactly(16),
-        boost::bind(&HTTPPlaySession::HandleFirstChunk, this,
-          boost::asio::placeholders::error));
+      // whatever followed the head is already body
+      size_t leftover = bytes - used;
+      memmove(_block.get(), _block.get() + used, leftover);
+      BeginBody();
+      if (_chunkedBody) {
+        // only the decoder knows where the body ends; a short one, like
+        // the last chunk alone, would never fill FIRST_CHUNK_SIZE
+        if (leftover) {
+          HandleFirstChunk(boost::system::error_code(), 0, leftover);
+        } else {
+          ReadFirstChunk(leftover, boost::asio::transfer_at_least(1));
+        }
+        return;
+      }
+      size_t needed = FIRST_CHUNK_SIZE;
+      if (_bodyRemaining >= 0 && _bodyRemaining < int64_t(needed)) {
+        needed = _bodyRemaining;
+      }
+      if (leftover >= needed) {
+        HandleFirstChunk(boost::system::error_code(), 0, leftover);
+        return;
+      }
+      ReadFirstChunk(leftover, boost::asio::transfer_exactly(needed - leftover));
 
     } else if (_socket.is_open()) {
-      _observer->OnError(this, ERROR_ON_RECV);
+      _context._observer->OnError(this, ERROR_ON_RECV);
     }
   }
 
-  void HandleFirstChunk(const boost::system::error_code& err) {
+  template <typename CompletionCondition>
+  void ReadFirstChunk(size_t leftover, CompletionCondition completion) {
+    boost::asio::async_read(_socket,
+      boost::asio::buffer(_block.get() + leftover, _blockSize - leftover),
+      completion,
+      boost::bind(&HTTPPlaySession::HandleFirstChunk, shared_from_this(),
+        boost::asio::placeholders::error,
+        boost::asio::placeholders::bytes_transferred, leftover));
+  }
+
+  // leftover: body bytes that came with the head, at the block's start
+  void HandleFirstChunk(const boost::system::error_code& err, size_t bytes,
+                        size_t leftover) {
     if (!err) {
       boost::chrono::milliseconds elapsed =
         boost::chrono::duration_cast<boost::chrono::milliseconds>(
           boost::chrono::system_clock::now() - _checkPoint);
-      _observer->OnFirstChunk(this, elapsed.count());
+      _context._observer->OnFirstChunk(this, elapsed.count());
 
-      size_t blocksize = _response.size();
-      _response.consume(blocksize);
+      size_t payload = DecodeContent(_block.get(), leftover + bytes);
 
-      if (blocksize) {
-        _contentBytes += blocksize;
-        _observer->OnTotalBytes(this, _contentBytes);
+      if (_bodyEnd != ChunkedDecoder::NEED_MORE) {
+        _contentBytes += payload;
+        FinishBody();
+        return;
+      }
+      if (payload) {
+        _contentBytes += payload;
+        _context._observer->OnTotalBytes(this, _contentBytes);
       }
       _checkPoint = boost::chrono::system_clock::now();
 
-      boost::asio::async_read(_socket, _response,
-        boost::asio::transfer_at_least(RECV_BLOCK_SIZE),
-        boost::bind(&HTTPPlaySession::HandleContent, this,
-          boost::asio::placeholders::error));
+      if (!_socket.is_open()) {
+        return;
+      }
+      // only the asio reactor reads into a block of the session's own
+      if (_context._uring && !_uringOff) {
+        ResizeBlock(0);
+        _uringToken = _context._uring->Arm(_socket.native_handle(), this);
+        _uringArmed = true;
+      } else if (_context._drain) {
+        ResizeBlock(0);
+        boost::system::error_code ec;
+        _socket.non_blocking(true, ec);
+        WaitContent();
+      } else {
+        ReadContent();
+      }
 
     } else if (err == boost::asio::error::eof) {
-      size_t blocksize = _response.size();
-      _response.consume(blocksize);
-      _observer->OnFinished(this);
+      HandleEof();
 
     } else if (_socket.is_open()) {
-      _observer->OnError(this, ERROR_ON_RECV);
+      _context._observer->OnError(this, ERROR_ON_RECV);
     }
   }
 
-  void HandleContent(const boost::system::error_code& err) {
-    if (!err) {
-      size_t blocksize = _response.size();
-      _response.consume(blocksize);
+  // Never waits for more than the current body can still deliver, or a
+  // keep-alive connection would stall at each response boundary.
+  void ReadContent() {
+    size_t least = _blockSize;
+    if (_nextHeader) {
+      least = 1;
+    } else if (_chunkedBody) {
+      least = std::max(uint64_t(1), std::min(uint64_t(least),
+                                             _chunked.DataRemaining()));
+    } else if (_bodyRemaining >= 0) {
+      least = std::max(int64_t(1), std::min(int64_t(least), _bodyRemaining));
+    }
+    boost::asio::async_read(_socket,
+      boost::asio::buffer(_block.get(), _blockSize),
+      boost::asio::transfer_at_least(least),
+      boost::bind(&HTTPPlaySession::HandleContent, shared_from_this(),
+        boost::asio::placeholders::error,
+        boost::asio::placeholders::bytes_transferred));
+  }
 
-      if (blocksize) {
-        _contentBytes += blocksize;
-        _statsBytes += blocksize;
+  // A block filled within the wheel tick of the one before belongs to a
+  // fast stream, which gets a larger block, up to RECV_BLOCK_SIZE; slow
+  // viewers keep the small one they read their head with.
+  void HandleContent(const boost::system::error_code& err, size_t bytes) {
+    if (!err || err == boost::asio::error::eof) {
+      bool quick = bytes == _blockSize &&
+                   _lastActive == _context._wheel.Now();
+      size_t payload = DecodeContent(_block.get(), bytes);
+      CountContent(payload);
+
+      if (_bodyEnd != ChunkedDecoder::NEED_MORE) {
+        FinishBody();
+      } else if (err) {
+        HandleEof();
+      } else {
+        _context._observer->OnTotalBytes(this, _contentBytes);
+        if (quick && _blockSize < RECV_BLOCK_SIZE) {
+          ResizeBlock(std::min(_blockSize * 2, uint32_t(RECV_BLOCK_SIZE)));
+        }
+        ReadContent();
+      }
 
-        if (_statsBytes > STATS_WINDOW_SIZE) {
-          boost::chrono::milliseconds duration =
-            boost::chrono::duration_cast<boost::chrono::milliseconds>(
-              boost::chrono::system_clock::now() - _checkPoint);
+    } else if (_socket.is_open()) {
+      _context._observer->OnError(this, ERROR_ON_RECV);
+    }
+  }
 
-          _observer->OnContent(this, _statsBytes,
-                               std::max(1LL, (long long)duration.count()));
+  // Drain mode: one reactor wakeup per readiness edge, then non-blocking
+  // reads until the socket runs dry, accounted as a single block. A sender
+  // as fast as the reads would keep it from running dry, so a wakeup stops
+  // at DRAIN_WAKEUP_SIZE and waits for readiness again.
+  void WaitContent() {
+    _socket.async_wait(tcp::socket::wait_read,
+      boost::bind(&HTTPPlaySession::HandleReadable, shared_from_this(),
+        boost::asio::placeholders::error));
+  }
 
-          _checkPoint = boost::chrono::system_clock::now();
-          _statsBytes = 0;
-        }
+  void HandleReadable(const boost::system::error_code& err) {
+    if (err) {
+      if (_socket.is_open()) {
+        _context._observer->OnError(this, ERROR_ON_RECV);
       }
+      return;
+    }
 
-      _observer->OnTotalBytes(this, _contentBytes);
+    static char drainBuf[DRAIN_BLOCK_SIZE];
+    boost::system::error_code ec;
+    size_t drained = 0;
+    size_t received = 0;
+    while (_bodyEnd == ChunkedDecoder::NEED_MORE &&
+           received < DRAIN_WAKEUP_SIZE) {
+      size_t n = _socket.read_some(boost::asio::buffer(drainBuf), ec);
+      if (ec) {
+        break;
+      }
+      received += n;
+      drained += DecodeContent(drainBuf, n);
+    }
+    CountContent(drained);
+
+    if (_bodyEnd != ChunkedDecoder::NEED_MORE) {
+      FinishBody();
+    } else if (!ec || ec == boost::asio::error::would_block) {
+      _context._observer->OnTotalBytes(this, _contentBytes);
+      if (_socket.is_open()) {
+        WaitContent();
+      }
+    } else if (ec == boost::asio::error::eof) {
+      HandleEof();
+    } else if (_socket.is_open()) {
+      _context._observer->OnError(this, ERROR_ON_RECV);
+    }
+  }
 
-      boost::asio::async_read(_socket, _response,
-        boost::asio::transfer_at_least(RECV_BLOCK_SIZE),
-        boost::bind(&HTTPPlaySession::HandleContent, this,
-          boost::asio::placeholders::error));
+  virtual void OnUringData(const char* data, size_t len) {
+    CountContent(DecodeContent(data, len));
+    if (_bodyEnd != ChunkedDecoder::NEED_MORE) {
+      FinishBody();
+    } else {
+      _context._observer->OnTotalBytes(this, _contentBytes);
+    }
+  }
 
-    } else if (err == boost::asio::error::eof) {
-      size_t blocksize = _response.size();
-      _response.consume(blocksize);
+  virtual void OnUringEnd(int res) {
+    _uringArmed = false;
+    if (res == 0) {
+      HandleEof();
+    } else if (res == -EINVAL || res == -EOPNOTSUPP) {
+      // kernel without multishot recv, carry on with the asio reactor
+      _uringOff = true;
+      ResizeBlock(HEADER_BLOCK_SIZE);
+      ReadContent();
+    } else if (_socket.is_open()) {
+      _context._observer->OnError(this, ERROR_ON_RECV);
+    }
+  }
 
-      if (blocksize) {
-        _contentBytes += blocksize;
-        _statsBytes += blocksize;
+  // Splits received bytes into payload and framing, returning the payload
+  // part. On keep-alive connections it also walks the heads of the
+  // responses that follow.
+  size_t DecodeContent(const char* data, size_t len) {
+    size_t payload = 0;
+    while (_bodyEnd == ChunkedDecoder::NEED_MORE) {
+      size_t used = 0;
+      if (_nextHeader) {
+        if (!len) {
+          break;
+        }
+        HTTPResponseParser::Result res = _parser->Feed(data, len, &used);
+        data += used;
+        len -= used;
+        if (res == HTTPResponseParser::NEED_MORE) {
+          break;
+        }
+        if (res == HTTPResponseParser::BAD || !Acceptable(*_parser)) {
+          _bodyEnd = ChunkedDecoder::BAD;
+          _endError = ERROR_BAD_HTTP;
+          break;
+        }
+        _context._observer->OnResponseHeader(this, *_parser);
+        _nextHeader = false;
+        BeginBody();
+        continue;
+      }
 
-        if (_statsBytes > STATS_WINDOW_SIZE) {
-          boost::chrono::milliseconds duration =
-            boost::chrono::duration_cast<boost::chrono::milliseconds>(
-              boost::chrono::system_clock::now() - _checkPoint);
+      if (_chunkedBody) {
+        if (!len) {
+          break;
+        }
+        size_t overhead = 0;
+        ChunkedDecoder::Result res =
+          _chunked.Feed(data, len, &payload, &overhead, &used);
+        _overheadBytes += overhead;
+        data += used;
+        len -= used;
+        if (res == ChunkedDecoder::BAD) {
+          _bodyEnd = ChunkedDecoder::BAD;
+          _endError = ERROR_BAD_CHUNKED;
+          break;
+        }
+        if (res == ChunkedDecoder::NEED_MORE) {
+          break;
+        }
+      } else if (_bodyRemaining >= 0) {
+        used = std::min(len, size_t(_bodyRemaining));
+        _bodyRemaining -= used;
+        payload += used;
+        data += used;
+        len -= used;
+        if (_bodyRemaining) {
+          break;
+        }
+      } else {
+        // delimited by connection close
+        payload += len;
+        break;
+      }
+      NextResponse();
+    }
+    return payload;
+  }
 
-          _observer->OnContent(this, _statsBytes,
-                               std::max(1LL, (long long)duration.count()));
+  static bool Acceptable(const HTTPResponseParser& hdr) {
+    return hdr.StatusCode() == 200 || hdr.StatusCode() == 206;
+  }
 
-          _checkPoint = boost::chrono::system_clock::now();
-          _statsBytes = 0;
-        }
+  // Takes what the body needs from the head; the parser goes with the
+  // last head the connection will see, which is also the one of a server
+  // that will not keep the connection open.
+  void BeginBody() {
+    _chunked.Reset();
+    _bodyRemaining = -1;
+    _chunkedBody = _parser->Chunked();
+    if (!_chunkedBody) {
+      if (_parser->ContentLength() >= 0) {
+        _bodyRemaining = _parser->ContentLength();
+      } else if (_parser->StatusCode() == 206 && _parser->RangeFirst() >= 0) {
+        _bodyRemaining = _parser->RangeLast() - _parser->RangeFirst() + 1;
       }
-      _observer->OnFinished(this);
+    }
+    _lastResponse = _responses + 1 >= _context._requests ||
+                    !_parser->KeepAlive();
+    if (_lastResponse) {
+      _parser.reset();
+      Account();
+    }
+  }
 
-    } else if (_socket.is_open()) {
-      _observer->OnError(this, ERROR_ON_RECV);
+  // EOF is the natural end of a close-delimited body, and a truncation
+  // of a body whose size was announced.
+  void HandleEof() {
+    if (_nextHeader || _chunkedBody || _bodyRemaining >= 0) {
+      _context._observer->OnError(this, ERROR_TRUNCATED_BODY);
+    } else {
+      _context._observer->OnFinished(this);
     }
   }
 
-  void HandleTimeout(size_t bytes) {
+  // One response body is complete: either expect the next response on
+  // this connection or end the session, cleanly once all requests were
+  // served, with ERROR_CLOSED_EARLY when the server announced it closes
+  // before that. A pipelined response is timed from the end of the one
+  // before it, its request went out with the first.
+  void NextResponse() {
+    boost::chrono::system_clock::time_point now =
+      boost::chrono::system_clock::now();
+    boost::chrono::milliseconds elapsed =
+      boost::chrono::duration_cast<boost::chrono::milliseconds>(
+        now - _requestStart);
+    _context._observer->OnResponse(this, elapsed.count());
+
+    if (++_responses < _context._requests && !_lastResponse) {
+      _parser->Reset();
+      _nextHeader = true;
+      if (_context._pipeline) {
+        _requestStart = now;
+      } else {
+        WriteNextRequest();
+      }
+    } else if (_responses < _context._requests) {
+      _bodyEnd = ChunkedDecoder::BAD;
+      _endError = ERROR_CLOSED_EARLY;
+    } else {
+      _bodyEnd = ChunkedDecoder::DONE;
+    }
+  }
+
+  void FinishBody() {
     if (!_socket.is_open()) {
       return;
     }
+    if (_bodyEnd == ChunkedDecoder::DONE) {
+      boost::chrono::milliseconds elapsed =
+        boost::chrono::duration_cast<boost::chrono::milliseconds>(
+          boost::chrono::system_clock::now() - _downloadStart);
+      _context._observer->OnCompleted(this, elapsed.count());
+    } else {
+      _context._observer->OnError(this, _endError);
+    }
+  }
 
-    if (_contentBytes == bytes) {
-      _observer->OnError(this, ERROR_TIMEOUT_FOR_NO_DATA);
+  void CountContent(size_t blocksize) {
+    if (!blocksize) {
+      return;
+    }
+    uint64_t now = _context._wheel.Now();
+    if (_stallTicks && _contentBytes && now - _lastActive >= _stallTicks) {
+      _context._observer->OnStall(this, int32_t((now - _lastActive) *
+                                                TimingWheel::TICK_MS));
+    }
+    _lastActive = now;
+    _contentBytes += blocksize;
+    _statsBytes += blocksize;
+
+    if (_statsBytes > STATS_WINDOW_SIZE) {
+      FlushStats();
+    }
+  }
+
+  // One wheel entry serves both the no-data timeout, once the request is
+  // out, and the end of the watch time, if any.
+  void ScheduleTimer() {
+    uint64_t expiry = _watchEnd ? _watchEnd : ~uint64_t(0);
+    if (_receiving) {
+      expiry = std::min(expiry,
+        _lastActive + TimingWheel::SecondsToTicks(_context._timeout));
+    }
+    if (expiry != ~uint64_t(0)) {
+      _context._wheel.Schedule(this, expiry);
+    }
+  }
+
+  virtual void OnTimer() {
+    uint64_t now = _context._wheel.Now();
+    if (_watchEnd && _watchEnd <= now) {
+      _context._observer->OnWatched(this);
+      return;
+    }
+    if (_receiving && !_socket.is_open()) {
+      return;
+    }
+
+    if (_receiving &&
+        _lastActive + TimingWheel::SecondsToTicks(_context._timeout) <= now) {
+      _context._observer->OnError(this, ERROR_TIMEOUT_FOR_NO_DATA);
       Disconnect();
     } else {
-      _timer.expires_from_now(boost::posix_time::seconds(_timeout));
-      _timer.async_wait(boost::bind(&HTTPPlaySession::HandleTimeout, this, _contentBytes));
+      ScheduleTimer();
     }
   }
 
+  // The block only ever holds what one handler is about to decode, so it
+  // is swapped rather than grown.
+  void ResizeBlock(uint32_t size) {
+    _block.reset(size ? new char[size] : NULL);
+    _blockSize = size;
+    Account();
+  }
+
+  void Account() {
+    size_t footprint = Footprint();
+    _context.Account(int64_t(footprint) - int64_t(_accounted));
+    _accounted = uint32_t(footprint);
+  }
+
 private:
-  Observable* _observer;
-  boost::shared_ptr<Summary> _sum;
-  tcp::resolver _resolver;
+  // largest members first, the flags packed at the end
+  HTTPSessionContext& _context;
+  boost::shared_ptr<HappyEyeballs> _connector;
+  RequestBuffer _request;
+  boost::scoped_ptr<HTTPResponseParser> _parser;
+  boost::scoped_array<char> _block;
   tcp::socket _socket;
-  boost::asio::deadline_timer _timer;
-  boost::asio::streambuf _request;
-  boost::asio::streambuf _response;
+  tcp::endpoint _remote;
+  ChunkedDecoder _chunked;
   boost::chrono::time_point<boost::chrono::system_clock> _checkPoint;
-  size_t _contentBytes;
-  size_t _statsBytes;
-  int32_t _timeout;
-  std::string _url;
+  boost::chrono::time_point<boost::chrono::system_clock> _requestStart;
+  boost::chrono::time_point<boost::chrono::system_clock> _downloadStart;
+  uint64_t _contentBytes;
+  size_t _byteLimit;
+  uint64_t _overheadBytes;
+  uint64_t _lastActive;
+  uint64_t _watchEnd;
+  uint64_t _uringToken;
+  int64_t _bodyRemaining;
+  uint32_t _urlId;
+  int32_t _edgeId;
+  int32_t _resolveMs;
+  uint32_t _statsBytes;
+  uint32_t _stallTicks;
+  uint32_t _blockSize;
+  uint32_t _accounted;
+  uint32_t _responses;
+  ChunkedDecoder::Result _bodyEnd;
+  uint8_t _endError;
+  bool _receiving;
+  bool _uringArmed;
+  bool _uringOff;
+  bool _nextHeader;
+  bool _chunkedBody;
+  bool _lastResponse;
 };
 
 #endif // HTTP_PLAYSESSION_HH_INCLUDED
@@ -0,0 +1,66 @@
+#ifndef HTTP_REQUEST_HH_INCLUDED
+#define HTTP_REQUEST_HH_INCLUDED
+
+#include <string>
+#include <boost/smart_ptr.hpp>
+#include <vector>
+#include "url.hpp"
+
+typedef boost::shared_ptr<const std::string> RequestBuffer;
+
+// Serialized GET requests, built once per URL and shared read-only by all
+// sessions playing it, indexed by the interned URL id. The header profile
+// (extra header lines, each ending in CRLF) is the same for every URL of a
+// cache.
+class HTTPRequestCache {
+public:
+  static RequestBuffer Build(const urdl::url& url,
+                             const std::string& profile = std::string()) {
+    std::string path = url.query().empty() ?
+                         url.path() : url.path() + "?" + url.query();
+    std::string* request = new std::string();
+    request->reserve(128 + path.size() + url.host().size() + profile.size());
+    request->append("GET ").append(path).append(" HTTP/1.1\r\n");
+    request->append("User-Agent: Mozilla/5.0 (Windows NT 6.1; WOW64)\r\n");
+    request->append("Host: ").append(url.host()).append("\r\n");
+    request->append("Accept: */*\r\n");
+    request->append(profile);
+    request->append("Connection: keep-alive\r\n\r\n");
+    return RequestBuffer(request);
+  }
+
+  void SetProfile(const std::string& profile) {
+    _profile = profile;
+    _requests.clear();
+  }
+
+  const RequestBuffer& Get(size_t id, const urdl::url& url) {
+    if (id >= _requests.size()) {
+      _requests.resize(id + 1);
+    }
+    RequestBuffer& request = _requests[id];
+    if (!request) {
+      request = Build(url, _profile);
+    }
+    return request;
+  }
+
+  // Uncached request with the cache's profile, for one-off URLs.
+  RequestBuffer Make(const urdl::url& url) const {
+    return Build(url, _profile);
+  }
+
+  size_t Size() const {
+    size_t built = 0;
+    for (size_t i = 0; i < _requests.size(); i++) {
+      if (_requests[i]) built++;
+    }
+    return built;
+  }
+
+private:
+  std::string _profile;
+  std::vector<RequestBuffer> _requests;
+};
+
+#endif // HTTP_REQUEST_HH_INCLUDED
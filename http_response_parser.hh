@@ -0,0 +1,403 @@
+#ifndef HTTP_RESPONSE_PARSER_HH_INCLUDED
+#define HTTP_RESPONSE_PARSER_HH_INCLUDED
+
+#include <cstring>
+#include <stdint.h>
+
+// Incremental parser for an HTTP response head (status line + headers).
+// Bytes may arrive in any split; nothing is allocated, the few headers the
+// results care about are kept in fixed buffers (longer values truncated).
+class HTTPResponseParser {
+public:
+  static const size_t MAX_NAME_LENGTH = 32;
+  static const size_t MAX_VALUE_LENGTH = 64;
+  static const size_t MAX_HEADER_LENGTH = 16 * 1024;
+
+  enum Result {
+    NEED_MORE,
+    DONE,
+    BAD
+  };
+
+  enum Field {
+    FIELD_OTHER,
+    FIELD_CONTENT_LENGTH,
+    FIELD_TRANSFER_ENCODING,
+    FIELD_CONTENT_TYPE,
+    FIELD_SERVER,
+    FIELD_VIA,
+    FIELD_CONTENT_RANGE,
+    FIELD_CONNECTION,
+    FIELD_MAX
+  };
+
+  HTTPResponseParser() {
+    Reset();
+  }
+
+  void Reset() {
+    _state = VERSION_H;
+    _length = 0;
+    _versionMajor = 0;
+    _versionMinor = 0;
+    _statusCode = 0;
+    _contentLength = -1;
+    _rangeFirst = -1;
+    _rangeLast = -1;
+    _rangeTotal = -1;
+    _chunked = false;
+    _close = false;
+    _keepAlive = false;
+    _contentType[0] = '\0';
+    _server[0] = '\0';
+    _via[0] = '\0';
+  }
+
+  // Consumes bytes up to and including the blank line ending the head;
+  // *used tells how many of the given bytes belong to it.
+  Result Feed(const char* data, size_t len, size_t* used) {
+    size_t i = 0;
+    Result res = NEED_MORE;
+    while (i < len && res == NEED_MORE) {
+      res = Consume(data[i++]);
+    }
+    *used = i;
+    _length += i;
+    if (res == NEED_MORE && _length > MAX_HEADER_LENGTH) {
+      res = BAD;
+    }
+    return res;
+  }
+
+  // Size of the whole response head once DONE.
+  size_t HeaderLength() const { return _length; }
+  int VersionMajor() const { return _versionMajor; }
+  int VersionMinor() const { return _versionMinor; }
+  int StatusCode() const { return _statusCode; }
+  // -1 when the response carries no Content-Length
+  int64_t ContentLength() const { return _contentLength; }
+  bool Chunked() const { return _chunked; }
+  // Whether the server keeps the connection open after this response:
+  // HTTP/1.1 unless it says close, HTTP/1.0 only when it says keep-alive.
+  bool KeepAlive() const {
+    if (_close) {
+      return false;
+    }
+    return _versionMajor > 1 || (_versionMajor == 1 && _versionMinor >= 1) ||
+           _keepAlive;
+  }
+  // Content-Range of a 206 response, -1 when absent or unsatisfied
+  int64_t RangeFirst() const { return _rangeFirst; }
+  int64_t RangeLast() const { return _rangeLast; }
+  int64_t RangeTotal() const { return _rangeTotal; }
+  const char* ContentType() const { return _contentType; }
+  const char* Server() const { return _server; }
+  const char* Via() const { return _via; }
+
+private:
+  enum State {
+    VERSION_H,
+    VERSION_T_1,
+    VERSION_T_2,
+    VERSION_P,
+    VERSION_SLASH,
+    VERSION_MAJOR_START,
+    VERSION_MAJOR,
+    VERSION_MINOR_START,
+    VERSION_MINOR,
+    STATUS_CODE_START,
+    STATUS_CODE,
+    REASON_PHRASE,
+    STATUS_LINEFEED,
+    HEADER_LINE_START,
+    HEADER_NAME,
+    HEADER_VALUE_START,
+    HEADER_VALUE,
+    HEADER_LINEFEED,
+    FINAL_LINEFEED,
+    FAIL
+  };
+
+  static bool IsDigit(char c) {
+    return c >= '0' && c <= '9';
+  }
+
+  static bool IsCtl(char c) {
+    return (c >= 0 && c <= 31) || c == 127;
+  }
+
+  static char ToLower(char c) {
+    return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+  }
+
+  Result Consume(char c) {
+    switch (_state) {
+    case VERSION_H:
+      _state = (c == 'H') ? VERSION_T_1 : FAIL;
+      break;
+    case VERSION_T_1:
+      _state = (c == 'T') ? VERSION_T_2 : FAIL;
+      break;
+    case VERSION_T_2:
+      _state = (c == 'T') ? VERSION_P : FAIL;
+      break;
+    case VERSION_P:
+      _state = (c == 'P') ? VERSION_SLASH : FAIL;
+      break;
+    case VERSION_SLASH:
+      _state = (c == '/') ? VERSION_MAJOR_START : FAIL;
+      break;
+    case VERSION_MAJOR_START:
+    case VERSION_MAJOR:
+      if (IsDigit(c) && _versionMajor < 10) {
+        _versionMajor = _versionMajor * 10 + c - '0';
+        _state = VERSION_MAJOR;
+      } else if (c == '.' && _state == VERSION_MAJOR) {
+        _state = VERSION_MINOR_START;
+      } else {
+        _state = FAIL;
+      }
+      break;
+    case VERSION_MINOR_START:
+    case VERSION_MINOR:
+      if (IsDigit(c) && _versionMinor < 10) {
+        _versionMinor = _versionMinor * 10 + c - '0';
+        _state = VERSION_MINOR;
+      } else if (c == ' ' && _state == VERSION_MINOR) {
+        _state = STATUS_CODE_START;
+      } else {
+        _state = FAIL;
+      }
+      break;
+    case STATUS_CODE_START:
+    case STATUS_CODE:
+      if (IsDigit(c) && _statusCode < 100) {
+        _statusCode = _statusCode * 10 + c - '0';
+        _state = STATUS_CODE;
+      } else if (_state == STATUS_CODE && _statusCode >= 100 &&
+                 (c == ' ' || c == '\r')) {
+        _state = (c == ' ') ? REASON_PHRASE : STATUS_LINEFEED;
+      } else {
+        _state = FAIL;
+      }
+      break;
+    case REASON_PHRASE:
+      if (c == '\r') {
+        _state = STATUS_LINEFEED;
+      } else if (IsCtl(c) && c != '\t') {
+        _state = FAIL;
+      }
+      break;
+    case STATUS_LINEFEED:
+    case HEADER_LINEFEED:
+      if (c != '\n') {
+        _state = FAIL;
+        break;
+      }
+      if (_state == HEADER_LINEFEED) {
+        FinishHeader();
+      }
+      _state = HEADER_LINE_START;
+      break;
+    case HEADER_LINE_START:
+      if (c == '\r') {
+        _state = FINAL_LINEFEED;
+      } else if (IsCtl(c) || c == ' ' || c == '\t' || c == ':') {
+        // obsolete line folding is not worth supporting here
+        _state = FAIL;
+      } else {
+        _nameLength = 0;
+        _valueLength = 0;
+        AppendName(c);
+        _state = HEADER_NAME;
+      }
+      break;
+    case HEADER_NAME:
+      if (c == ':') {
+        _field = LookupField();
+        _state = HEADER_VALUE_START;
+      } else if (IsCtl(c) || c == ' ' || c == '\t') {
+        _state = FAIL;
+      } else {
+        AppendName(c);
+      }
+      break;
+    case HEADER_VALUE_START:
+      if (c == ' ' || c == '\t') {
+        break;
+      }
+      _state = HEADER_VALUE;
+      // fall through
+    case HEADER_VALUE:
+      if (c == '\r') {
+        _state = HEADER_LINEFEED;
+      } else if (IsCtl(c) && c != '\t') {
+        _state = FAIL;
+      } else if (_field != FIELD_OTHER &&
+                 _valueLength < MAX_VALUE_LENGTH - 1) {
+        _value[_valueLength++] = c;
+      }
+      break;
+    case FINAL_LINEFEED:
+      if (c == '\n') {
+        return DONE;
+      }
+      _state = FAIL;
+      break;
+    case FAIL:
+      break;
+    }
+    return _state == FAIL ? BAD : NEED_MORE;
+  }
+
+  void AppendName(char c) {
+    if (_nameLength < MAX_NAME_LENGTH) {
+      _name[_nameLength] = ToLower(c);
+    }
+    _nameLength++;
+  }
+
+  Field LookupField() const {
+    static const char* const names[FIELD_MAX] = {
+      "", "content-length", "transfer-encoding",
+      "content-type", "server", "via", "content-range", "connection"
+    };
+    if (_nameLength > MAX_NAME_LENGTH) {
+      return FIELD_OTHER;
+    }
+    for (int i = FIELD_OTHER + 1; i < FIELD_MAX; i++) {
+      if (strlen(names[i]) == _nameLength &&
+          memcmp(names[i], _name, _nameLength) == 0) {
+        return Field(i);
+      }
+    }
+    return FIELD_OTHER;
+  }
+
+  void FinishHeader() {
+    while (_valueLength &&
+           (_value[_valueLength - 1] == ' ' ||
+            _value[_valueLength - 1] == '\t')) {
+      _valueLength--;
+    }
+    _value[_valueLength] = '\0';
+
+    switch (_field) {
+    case FIELD_CONTENT_LENGTH: {
+      size_t i = 0;
+      int64_t length = ParseNumber(&i);
+      if (i == _valueLength && length >= 0) {
+        _contentLength = length;
+      }
+      break;
+    }
+    case FIELD_CONTENT_RANGE: {
+      // bytes <first>-<last>/<total|*>
+      static const char unit[] = "bytes ";
+      size_t i = sizeof(unit) - 1;
+      if (_valueLength < i || memcmp(_value, unit, i) != 0) {
+        break;
+      }
+      int64_t first = ParseNumber(&i);
+      if (first < 0 || i >= _valueLength || _value[i++] != '-') {
+        break;
+      }
+      int64_t last = ParseNumber(&i);
+      if (last < first || i >= _valueLength || _value[i++] != '/') {
+        break;
+      }
+      _rangeFirst = first;
+      _rangeLast = last;
+      _rangeTotal = ParseNumber(&i);
+      break;
+    }
+    case FIELD_TRANSFER_ENCODING: {
+      // chunked has to be the last coding applied
+      static const char chunked[] = "chunked";
+      size_t n = sizeof(chunked) - 1;
+      _chunked = false;
+      if (_valueLength >= n) {
+        const char* tail = _value + _valueLength - n;
+        size_t i = 0;
+        while (i < n && ToLower(tail[i]) == chunked[i]) i++;
+        _chunked = (i == n) &&
+                   (_valueLength == n || tail[-1] == ',' || tail[-1] == ' ');
+      }
+      break;
+    }
+    case FIELD_CONNECTION:
+      // a comma separated list of tokens, any case
+      for (size_t i = 0; i < _valueLength;) {
+        while (i < _valueLength && (_value[i] == ',' || _value[i] == ' ' ||
+                                    _value[i] == '\t')) i++;
+        size_t start = i;
+        while (i < _valueLength && _value[i] != ',' && _value[i] != ' ' &&
+               _value[i] != '\t') i++;
+        if (TokenIs(start, i, "close")) {
+          _close = true;
+        } else if (TokenIs(start, i, "keep-alive")) {
+          _keepAlive = true;
+        }
+      }
+      break;
+    case FIELD_CONTENT_TYPE:
+      memcpy(_contentType, _value, _valueLength + 1);
+      break;
+    case FIELD_SERVER:
+      memcpy(_server, _value, _valueLength + 1);
+      break;
+    case FIELD_VIA:
+      memcpy(_via, _value, _valueLength + 1);
+      break;
+    default:
+      break;
+    }
+  }
+
+  // Whether _value[start, end) is token, ignoring case.
+  bool TokenIs(size_t start, size_t end, const char* token) const {
+    size_t i = 0;
+    for (; start + i < end && token[i]; i++) {
+      if (ToLower(_value[start + i]) != token[i]) {
+        return false;
+      }
+    }
+    return start + i == end && !token[i];
+  }
+
+  // Reads decimal digits of the current value from *pos on, -1 if none.
+  int64_t ParseNumber(size_t* pos) const {
+    size_t i = *pos;
+    int64_t number = 0;
+    for (; i < _valueLength && IsDigit(_value[i]) &&
+           number < (int64_t(1) << 56); i++) {
+      number = number * 10 + _value[i] - '0';
+    }
+    bool found = i > *pos;
+    *pos = i;
+    return found ? number : -1;
+  }
+
+  State _state;
+  Field _field;
+  size_t _length;
+  size_t _nameLength;
+  size_t _valueLength;
+  int _versionMajor;
+  int _versionMinor;
+  int _statusCode;
+  int64_t _contentLength;
+  int64_t _rangeFirst;
+  int64_t _rangeLast;
+  int64_t _rangeTotal;
+  bool _chunked;
+  bool _close;
+  bool _keepAlive;
+  char _name[MAX_NAME_LENGTH];
+  char _value[MAX_VALUE_LENGTH];
+  char _contentType[MAX_VALUE_LENGTH];
+  char _server[MAX_VALUE_LENGTH];
+  char _via[MAX_VALUE_LENGTH];
+};
+
+#endif // HTTP_RESPONSE_PARSER_HH_INCLUDED
@@ -1,7 +1,10 @@
 #include <iostream>
 #include <string>
+#include "agent.hh"
+#include "controller.hh"
 #include "test_config.hh"
 #include "test_arena.hh"
+#include "worker_pool.hh"
 
 int main(int argc, char* argv[])
 {
@@ -11,6 +14,26 @@ int main(int argc, char* argv[])
     return 1;
   }
 
+  if (!cfg.AgentAddress().empty()) {
+    Agent agent(cfg);
+    agent.Run();
+    return 0;
+  }
+
+  if (!cfg.Controlled().empty()) {
+    Controller controller(cfg);
+    bool started = controller.Run();
+    controller.PrintResult();
+    return started ? 0 : 1;
+  }
+
+  if (cfg.Procs() > 1) {
+    WorkerPool pool(cfg);
+    pool.Run();
+    pool.PrintResult();
+    return 0;
+  }
+
   TestArena arena;
   arena.SetConfig(cfg);
   arena.Run();
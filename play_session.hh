@@ -3,9 +3,10 @@
 
 #include <string>
 #include <stdint.h>
-#include <boost/smart_ptr.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include "url.hpp"
 
-class Summary;
+class HTTPResponseParser;
 struct PlaySession {
   enum ErrorCode {
     HTTP_ERROR_BASE = 0x0000,
@@ -16,17 +17,44 @@ struct PlaySession {
     virtual void OnResolved(PlaySession* sess, int32_t dur_in_ms) = 0;
     virtual void OnConnected(PlaySession* sess, int32_t dur_in_ms) = 0;
     virtual void OnRecvHeader(PlaySession* sess, int32_t dur_in_ms) = 0;
+    virtual void OnResponseHeader(PlaySession* sess,
+                                  const HTTPResponseParser& hdr) = 0;
     virtual void OnFirstChunk(PlaySession* sess, int32_t dur_in_ms) = 0;
     virtual void OnContent(PlaySession* sess, size_t bytes, int32_t dur_in_ms) = 0;
+    // data came again after a gap of at least the stall time
+    virtual void OnStall(PlaySession* sess, int32_t gap_in_ms) = 0;
+    virtual void OnResponse(PlaySession* sess, int32_t dur_in_ms) = 0;
     virtual void OnTotalBytes(PlaySession* sess, size_t totalbytes) = 0;
     virtual void OnFinished(PlaySession* sess) = 0;
+    virtual void OnCompleted(PlaySession* sess, int32_t dur_in_ms) = 0;
+    // the watch time given to the session is over
+    virtual void OnWatched(PlaySession* sess) = 0;
     virtual void OnError(PlaySession* sess, uint32_t ec) = 0;
   };
 
   virtual ~PlaySession() {}
+  virtual void Start(const urdl::url& url) = 0;
+  // leave after ms, counted from now
+  virtual void SetWatchTime(int32_t ms) = 0;
+  // report data gaps of at least ms, 0 for none
+  virtual void SetStallTime(int32_t ms) = 0;
+  // payload bytes after which the session has had enough
+  virtual void SetByteLimit(size_t bytes) = 0;
+  virtual size_t ByteLimit() const = 0;
   virtual void Disconnect() = 0;
-  virtual std::string GetPlayURL() const = 0;
-  virtual const boost::shared_ptr<Summary>& GetSummary() const = 0;
+  // reports the data counted since the last OnContent, if any
+  virtual void FlushStats() = 0;
+  // interned id of the played URL, see TestConfig
+  virtual size_t GetURLId() const = 0;
+  virtual size_t PayloadBytes() const = 0;
+  virtual size_t OverheadBytes() const = 0;
+  // endpoint the session ended up connected to, unspecified before that
+  virtual const boost::asio::ip::tcp::endpoint& RemoteEndpoint() const = 0;
+  // -1 when the host needed no lookup
+  virtual int32_t ResolveMillis() const = 0;
+  // remote endpoint id attached by the observer once connected, -1 before
+  virtual int32_t GetEdgeId() const = 0;
+  virtual void SetEdgeId(int32_t id) = 0;
 };
 
 #endif // PLAYSESSION_HH_INCLUDED
@@ -0,0 +1,42 @@
+#ifndef RESOLVE_CACHE_HH_INCLUDED
+#define RESOLVE_CACHE_HH_INCLUDED
+
+#include <string>
+#include <stdint.h>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/unordered_map.hpp>
+
+using boost::asio::ip::tcp;
+
+// Lookups shared by the sessions of a run, so that a host is resolved
+// once and later sessions connect straight away. Entries are kept for
+// the whole run; resolver iterators share their endpoint list, so a hit
+// copies no addresses.
+class ResolveCache : private boost::noncopyable {
+public:
+  static std::string Key(const std::string& host, uint16_t port) {
+    return host + ":" + boost::lexical_cast<std::string>(port);
+  }
+
+  bool Find(const std::string& key, tcp::resolver::iterator* it) const {
+    Entries::const_iterator entry = _entries.find(key);
+    if (entry == _entries.end()) {
+      return false;
+    }
+    *it = entry->second;
+    return true;
+  }
+
+  void Insert(const std::string& key, const tcp::resolver::iterator& it) {
+    _entries[key] = it;
+  }
+
+private:
+  typedef boost::unordered_map<std::string, tcp::resolver::iterator> Entries;
+
+  Entries _entries;
+};
+
+#endif // RESOLVE_CACHE_HH_INCLUDED
@@ -0,0 +1,64 @@
+#ifndef SCENARIO_HH_INCLUDED
+#define SCENARIO_HH_INCLUDED
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <boost/foreach.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+// One stretch of a load shape. A phase either steers concurrency linearly
+// from where the previous phase left it to target, or opens sessions at a
+// fixed arrival rate; either way it lasts duration seconds. The implicit
+// phase of a plain run is rate driven, capped at sessions, and lasts until
+// those sessions are done.
+struct Phase {
+  Phase()
+    : _duration(-1)
+    , _target(-1)
+    , _rate(-1)
+    , _sessions(0) {
+  }
+
+  std::string _name;
+  double _duration;  // seconds, < 0 for no limit
+  double _target;    // concurrency at the end, < 0 when rate driven
+  double _rate;      // arrivals per second, < 0 for all at once
+  size_t _sessions;  // arrival cap, 0 for none
+
+  bool RateDriven() const {
+    return _target < 0;
+  }
+};
+
+// most phases a run on several processes or agents reports phase by phase
+static const size_t MAX_SHARED_PHASES = 16;
+
+// "scenario": [ {"name": "ramp", "duration": 600, "target": 40000},
+//               {"name": "hold", "duration": 1800, "target": 40000},
+//               {"name": "spike", "duration": 5, "target": 50000},
+//               {"name": "drain", "duration": 60, "target": 0},
+//               {"duration": 60, "rate": 200} ]
+inline bool ParseScenario(const boost::property_tree::ptree& scenario,
+                          std::vector<Phase>* phases) {
+  BOOST_FOREACH (const boost::property_tree::ptree::value_type& item,
+                 scenario) {
+    const boost::property_tree::ptree& node = item.second;
+    Phase phase;
+    phase._duration = node.get<double>("duration", -1);
+    phase._target = node.get<double>("target", -1);
+    phase._rate = node.get<double>("rate", -1);
+    if (phase._duration < 0 || (phase._target < 0) == (phase._rate < 0)) {
+      std::cout << "scenario phase " << phases->size()
+                << " needs a duration and either a target or a rate\n";
+      return false;
+    }
+    std::stringstream name;
+    name << "phase " << phases->size();
+    phase._name = node.get<std::string>("name", name.str());
+    phases->push_back(phase);
+  }
+  return !phases->empty();
+}
+
+#endif // SCENARIO_HH_INCLUDED
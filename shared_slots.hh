@@ -0,0 +1,85 @@
+#ifndef SHARED_SLOTS_HH_INCLUDED
+#define SHARED_SLOTS_HH_INCLUDED
+
+#include <cstring>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <boost/noncopyable.hpp>
+
+// Fixed array of T in anonymous memory shared with the processes forked
+// after Create(), one writer per slot. Every slot is a seqlock: the writer
+// makes the sequence odd, copies the value in and makes it even again,
+// readers copy until they got it between two equal even sequences. No
+// side ever blocks the other. T must be trivially copyable.
+template <class T>
+class SharedSlots : private boost::noncopyable {
+public:
+  // a reader gives up after this many torn copies, e.g. of a writer that
+  // died halfway through
+  static const int READ_RETRIES = 1000;
+
+  SharedSlots()
+    : _slots(NULL)
+    , _count(0) {
+  }
+
+  ~SharedSlots() {
+    if (_slots) {
+      munmap(_slots, _count * sizeof(Slot));
+    }
+  }
+
+  bool Create(size_t count) {
+    void* mem = mmap(NULL, count * sizeof(Slot), PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+      return false;
+    }
+    _slots = static_cast<Slot*>(mem);
+    _count = count;
+    return true;
+  }
+
+  size_t Count() const {
+    return _count;
+  }
+
+  void Publish(size_t index, const T& value) {
+    Slot& slot = _slots[index];
+    uint32_t seq = __atomic_load_n(&slot._seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot._seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(&slot._value, &value, sizeof(T));
+    __atomic_store_n(&slot._seq, seq + 2, __ATOMIC_RELEASE);
+  }
+
+  // False when nothing was published to the slot yet, or no clean copy
+  // could be taken.
+  bool Read(size_t index, T* value) const {
+    const Slot& slot = _slots[index];
+    for (int i = 0; i < READ_RETRIES; i++) {
+      uint32_t before = __atomic_load_n(&slot._seq, __ATOMIC_ACQUIRE);
+      if (before & 1) {
+        continue;
+      }
+      memcpy(value, &slot._value, sizeof(T));
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      if (__atomic_load_n(&slot._seq, __ATOMIC_RELAXED) == before) {
+        return before != 0;
+      }
+    }
+    return false;
+  }
+
+private:
+  // slots on cache lines of their own, writers do not share any
+  struct Slot {
+    uint32_t _seq;
+    T _value;
+  } __attribute__((aligned(64)));
+
+  Slot* _slots;
+  size_t _count;
+};
+
+#endif // SHARED_SLOTS_HH_INCLUDED
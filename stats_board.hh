@@ -0,0 +1,130 @@
+#ifndef STATS_BOARD_HH_INCLUDED
+#define STATS_BOARD_HH_INCLUDED
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <boost/chrono/include.hpp>
+#include "test_arena.hh"
+
+// The latest stats of several load sources, worker processes or agents,
+// rendered as a combined live line and a combined final report.
+class StatsBoard {
+public:
+  explicit StatsBoard(const std::string& kind)
+    : _kind(kind)
+    , _lastReceived(0)
+    , _lastElapsed(0) {
+    _start = boost::chrono::steady_clock::now();
+  }
+
+  void Resize(size_t count) {
+    _stats.resize(count);
+  }
+
+  size_t Size() const {
+    return _stats.size();
+  }
+
+  WorkerStats& operator[](size_t i) {
+    return _stats[i];
+  }
+
+  const WorkerStats& operator[](size_t i) const {
+    return _stats[i];
+  }
+
+  WorkerStats Combined() const {
+    WorkerStats total;
+    total._done = true;
+    for (size_t i = 0; i < _stats.size(); i++) {
+      total._overall.Merge(_stats[i]._overall);
+      for (size_t p = 0; p < _stats[i]._phaseCount; p++) {
+        total._phases[p].Merge(_stats[i]._phases[p]);
+      }
+      total._phaseCount = std::max(total._phaseCount, _stats[i]._phaseCount);
+      total._active += _stats[i]._active;
+      total._received += _stats[i]._received;
+      total._sessionBytes += _stats[i]._sessionBytes;
+      total._sessionsAtPeak += _stats[i]._sessionsAtPeak;
+      total._maxSessions += _stats[i]._maxSessions;
+      total._rssGrowth += _stats[i]._rssGrowth;
+      total._done = total._done && _stats[i]._done;
+    }
+    return total;
+  }
+
+  // running: sources still at work; the receive rate is taken over the
+  // time since the previous line
+  void PrintLive(size_t running) {
+    WorkerStats total = Combined();
+    double elapsed = boost::chrono::duration<double>(
+      boost::chrono::steady_clock::now() - _start).count();
+    double mbps = elapsed > _lastElapsed && total._received >= _lastReceived ?
+      (total._received - _lastReceived) * 8 / 1e6 / (elapsed - _lastElapsed) :
+      0;
+    _lastReceived = total._received;
+    _lastElapsed = elapsed;
+
+    std::stringstream rate;
+    rate.setf(std::ios::fixed);
+    rate.precision(1);
+    rate << mbps;
+    std::cout << "[" << int(elapsed) << "s]"
+      << "  " << _kind << "s: " << running << "/" << _stats.size()
+      << "  active: " << total._active
+      << "  sessions: " << total._overall.Attempts()
+      << "  errors: " << total._overall.Errors()
+      << "  first_chunk (p99): "
+        << TestArena::Percentile(total._overall._firstChunkHist, 0.99)
+        << " (ms)"
+      << "  recv: " << rate.str() << " (Mbit/s)"
+      << std::endl;
+  }
+
+  // names and states of the sources, one each; phases of the scenario
+  // the sources ran, if any
+  void PrintResult(const std::vector<std::string>& names,
+                   const std::vector<std::string>& states,
+                   const std::vector<Phase>& phases) const {
+    WorkerStats combined = Combined();
+    Summary total;
+    total.Merge(combined._overall);
+    std::cout << "Result for all (" << _stats.size() << " " << _kind
+              << "s):\n";
+    TestArena::PrintOneItem(&total);
+    for (size_t i = 0; i < combined._phaseCount && i < phases.size(); i++) {
+      Summary phase;
+      phase.Merge(combined._phases[i]);
+      std::cout << "Result for " << phases[i]._name << ":\n";
+      TestArena::PrintOneItem(&phase);
+    }
+    // peaks of the sources added up, whenever each was reached
+    TestArena::PrintMemory(combined);
+
+    std::cout << "Result by " << _kind << ":\n";
+    for (size_t i = 0; i < _stats.size(); i++) {
+      const SummaryStats& sum = _stats[i]._overall;
+      std::cout << "  " << names[i]
+        << "  sessions: " << sum.Attempts()
+        << "  errors: " << sum.Errors()
+        << "  first_chunk (avg/p99): "
+          << sum._firstChunk.Value() << "/"
+          << TestArena::Percentile(sum._firstChunkHist, 0.99) << " (ms)"
+        << "  bytes (payload): " << sum._payloadBytes
+        << "  " << states[i]
+        << std::endl;
+    }
+  }
+
+private:
+  std::string _kind;
+  std::vector<WorkerStats> _stats;
+  boost::chrono::steady_clock::time_point _start;
+  uint64_t _lastReceived;
+  double _lastElapsed;
+};
+
+#endif // STATS_BOARD_HH_INCLUDED
@@ -1,14 +1,20 @@
 #ifndef TEST_ARENA_HH_INCLUDED
 #define TEST_ARENA_HH_INCLUDED
 
+#include <fstream>
 #include <memory>
 #include <sstream>
-#include <boost/thread/thread.hpp>
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/make_shared.hpp>
 #include <boost/unordered_map.hpp>
+#include <sys/resource.h>
 #include <unistd.h>
+#include "access_log.hh"
+#include "histogram.hh"
 #include "http_play_session.hh"
+#include "shared_slots.hh"
 #include "test_config.hh"
 #include "url.hpp"
 
@@ -43,6 +49,17 @@ struct Average {
     _updated = true;
   }
 
+  void Merge(const Average& other) {
+    if (!other._updated) {
+      return;
+    }
+    _den += other._den;
+    _num += other._num;
+    _max = std::max(_max, other._max);
+    _min = std::min(_min, other._min);
+    _updated = true;
+  }
+
   std::string Value() const {
     if (!_updated) {
       return std::string("-");
@@ -106,15 +123,69 @@ struct CsvRecord {
   std::deque<int32_t> _values;
 };
 
-struct Summary {
+struct HeaderTally {
+  static const int MAX_ENTRIES = 8;
+
+  HeaderTally()
+    : _size(0)
+    , _other(0) {
+    memset(_counts, 0, sizeof(_counts));
+  }
+
+  char _values[MAX_ENTRIES][HTTPResponseParser::MAX_VALUE_LENGTH];
+  size_t _counts[MAX_ENTRIES];
+  int _size;
+  size_t _other;
+
+  void Add(const char* value) {
+    if (!*value) {
+      return;
+    }
+    for (int i = 0; i < _size; i++) {
+      if (strcmp(_values[i], value) == 0) {
+        _counts[i]++;
+        return;
+      }
+    }
+    if (_size == MAX_ENTRIES) {
+      _other++;
+      return;
+    }
+    strcpy(_values[_size], value);
+    _counts[_size++] = 1;
+  }
+
+  std::string Value() const {
+    if (!_size) {
+      return std::string("-");
+    }
+    std::stringstream stream;
+    for (int i = 0; i < _size; i++) {
+      stream << (i ? ", " : "") << _values[i] << "(" << _counts[i] << ")";
+    }
+    if (_other) {
+      stream << ", others(" << _other << ")";
+    }
+    return stream.str();
+  }
+};
+
+// The plain counters of a summary: trivially copyable, so they can be
+// published through shared memory, and mergeable.
+struct SummaryStats {
   static const int MAX_ERROR_COUNT =
     HTTPPlaySession::ERROR_MAX - HTTPPlaySession::ERROR_BASE;
 
-  Summary()
-    : _resolve("resolve cost (ms)")
-    , _connect("connect cost (ms)")
-    , _recvhdr("recvhdr cost (ms)")
-    , _1stchunk("1stchunk cost (ms)") {
+  SummaryStats()
+    : _sizedBodies(0)
+    , _chunkedBodies(0)
+    , _closeBodies(0)
+    , _partialBodies(0)
+    , _completed(0)
+    , _left(0)
+    , _stalls(0)
+    , _payloadBytes(0)
+    , _overheadBytes(0) {
     memset(_errors, 0, sizeof(_errors));
   }
 
@@ -123,13 +194,85 @@ struct Summary {
   Average<size_t, int32_t> _recvHeader;
   Average<size_t, int32_t> _firstChunk;
   Average<size_t, int64_t> _kBytesPerSec;
+  Average<size_t, int32_t> _response;
+  Average<size_t, int32_t> _download;
+  Average<size_t, int32_t> _stallGap;
+
+  Histogram _connectHist;
+  Histogram _firstChunkHist;
+
+  size_t _sizedBodies;
+  size_t _chunkedBodies;
+  size_t _closeBodies;
+  size_t _partialBodies;
+  size_t _completed;
+  size_t _left;
+  size_t _stalls;
+  uint64_t _payloadBytes;
+  uint64_t _overheadBytes;
+
+  size_t _errors[MAX_ERROR_COUNT];
+
+  void Merge(const SummaryStats& other) {
+    _resolving.Merge(other._resolving);
+    _connecting.Merge(other._connecting);
+    _recvHeader.Merge(other._recvHeader);
+    _firstChunk.Merge(other._firstChunk);
+    _kBytesPerSec.Merge(other._kBytesPerSec);
+    _response.Merge(other._response);
+    _download.Merge(other._download);
+    _stallGap.Merge(other._stallGap);
+    _connectHist.Merge(other._connectHist);
+    _firstChunkHist.Merge(other._firstChunkHist);
+    _sizedBodies += other._sizedBodies;
+    _chunkedBodies += other._chunkedBodies;
+    _closeBodies += other._closeBodies;
+    _partialBodies += other._partialBodies;
+    _completed += other._completed;
+    _left += other._left;
+    _stalls += other._stalls;
+    _payloadBytes += other._payloadBytes;
+    _overheadBytes += other._overheadBytes;
+    for (int i = 0; i < MAX_ERROR_COUNT; i++) {
+      _errors[i] += other._errors[i];
+    }
+  }
+
+  size_t Errors() const {
+    size_t total = 0;
+    for (int i = 0; i < MAX_ERROR_COUNT; i++) {
+      total += _errors[i];
+    }
+    return total;
+  }
+
+  // sessions that got connected or failed before
+  size_t Attempts() const {
+    return _connecting._den +
+      _errors[HTTPPlaySession::ERROR_ON_RESOLVE - HTTPPlaySession::ERROR_BASE] +
+      _errors[HTTPPlaySession::ERROR_ON_CONNECT - HTTPPlaySession::ERROR_BASE];
+  }
+};
+
+struct Summary : public SummaryStats {
+  Summary()
+    : _resolve("resolve cost (ms)")
+    , _connect("connect cost (ms)")
+    , _recvhdr("recvhdr cost (ms)")
+    , _1stchunk("1stchunk cost (ms)")
+    , _respond("response cost (ms)")
+    , _complete("download cost (ms)") {
+  }
 
   CsvRecord _resolve;
   CsvRecord _connect;
   CsvRecord _recvhdr;
   CsvRecord _1stchunk;
+  CsvRecord _respond;
+  CsvRecord _complete;
 
-  size_t _errors[MAX_ERROR_COUNT];
+  HeaderTally _servers;
+  HeaderTally _contentTypes;
 
   void UpdateResolving(int32_t dur,
                        bool record = false) {
@@ -142,6 +285,7 @@ struct Summary {
   void UpdateConnecting(int32_t dur,
                         bool record = false) {
     _connecting.Update(1, dur);
+    _connectHist.Add(dur);
     if (record) {
       _connect.AddValue(dur);
     }
@@ -158,11 +302,58 @@ struct Summary {
   void UpdateFirstChunk(int32_t dur,
                         bool record = false) {
     _firstChunk.Update(1, dur);
+    _firstChunkHist.Add(dur);
     if (record) {
       _1stchunk.AddValue(dur);
     }
   }
 
+  void UpdateResponseHeader(const HTTPResponseParser& hdr) {
+    _servers.Add(*hdr.Server() ? hdr.Server() : hdr.Via());
+    _contentTypes.Add(hdr.ContentType());
+    if (hdr.Chunked()) {
+      _chunkedBodies++;
+    } else if (hdr.ContentLength() >= 0 || hdr.RangeFirst() >= 0) {
+      _sizedBodies++;
+    } else {
+      _closeBodies++;
+    }
+    if (hdr.StatusCode() == 206) {
+      _partialBodies++;
+    }
+  }
+
+  void UpdateResponse(int32_t dur,
+                      bool record = false) {
+    _response.Update(1, dur);
+    if (record) {
+      _respond.AddValue(dur);
+    }
+  }
+
+  void UpdateTransfer(size_t payload, size_t overhead) {
+    _payloadBytes += payload;
+    _overheadBytes += overhead;
+  }
+
+  void UpdateCompleted(int32_t dur,
+                       bool record = false) {
+    _completed++;
+    _download.Update(1, dur);
+    if (record) {
+      _complete.AddValue(dur);
+    }
+  }
+
+  void UpdateLeft() {
+    _left++;
+  }
+
+  void UpdateStall(int32_t gap) {
+    _stalls++;
+    _stallGap.Update(1, gap);
+  }
+
   void UpdateKBytesPerSec(int64_t bytes, int32_t dur) {
     _kBytesPerSec.Update(dur, bytes);
   }
@@ -175,172 +366,822 @@ struct Summary {
   }
 
   void WriteToCSV(std::ofstream& fs) {
-#define WRITE_LINE(x1,x2,x3,x4) fs<<(x1)<<","<<(x2)<<","<<(x3)<<","<<(x4)<<"\n"
-    WRITE_LINE(_resolve.Name(), _connect.Name(), _recvhdr.Name(), _1stchunk.Name());
-    size_t cnt_array[4] = { _resolve.Size(), _connect.Size(),
-                            _recvhdr.Size(), _1stchunk.Size() };
-    size_t* cnt = std::max_element(cnt_array, cnt_array + 4);
+#define WRITE_LINE(x1,x2,x3,x4,x5,x6) fs<<(x1)<<","<<(x2)<<","<<(x3)<<","<<(x4)<<","<<(x5)<<","<<(x6)<<"\n"
+    WRITE_LINE(_resolve.Name(), _connect.Name(), _recvhdr.Name(),
+               _1stchunk.Name(), _respond.Name(), _complete.Name());
+    size_t cnt_array[6] = { _resolve.Size(), _connect.Size(),
+                            _recvhdr.Size(), _1stchunk.Size(),
+                            _respond.Size(), _complete.Size() };
+    size_t* cnt = std::max_element(cnt_array, cnt_array + 6);
     for (size_t i = 0; i < *cnt; i++) {
       WRITE_LINE(_resolve.GetValue(i),
                  _connect.GetValue(i),
                  _recvhdr.GetValue(i),
-                 _1stchunk.GetValue(i));
+                 _1stchunk.GetValue(i),
+                 _respond.GetValue(i),
+                 _complete.GetValue(i));
     }
 #undef WRITE_LINE
   }
 };
 
+// What a worker process publishes to the parent, see WorkerPool.
+struct WorkerStats {
+  WorkerStats()
+    : _phaseCount(0)
+    , _active(0)
+    , _received(0)
+    , _sessionBytes(0)
+    , _sessionsAtPeak(0)
+    , _maxSessions(0)
+    , _rssGrowth(0)
+    , _done(false) {
+  }
+
+  SummaryStats _overall;
+  // the scenario phases, all of them whether they started or not
+  SummaryStats _phases[MAX_SHARED_PHASES];
+  uint64_t _phaseCount;
+  uint64_t _active;     // sessions running
+  uint64_t _received;   // payload bytes, running sessions included
+  // memory: what the sessions held at their peak, and the sessions then;
+  // the most sessions at once, and the peak RSS over the one at the start
+  uint64_t _sessionBytes;
+  uint64_t _sessionsAtPeak;
+  uint64_t _maxSessions;
+  uint64_t _rssGrowth;
+  bool _done;
+};
+
+typedef SharedSlots<WorkerStats> WorkerSlots;
+
+// Remote endpoint as plain integers, IPv4 mapped into the IPv6 space, so
+// looking an edge up never formats or hashes address strings.
+struct EdgeKey {
+  explicit EdgeKey(const tcp::endpoint& endpoint)
+    : _high(0)
+    , _low(0)
+    , _port(endpoint.port()) {
+    boost::asio::ip::address_v6 addr = endpoint.address().is_v4() ?
+      boost::asio::ip::address_v6::v4_mapped(endpoint.address().to_v4()) :
+      endpoint.address().to_v6();
+    boost::asio::ip::address_v6::bytes_type bytes = addr.to_bytes();
+    for (int i = 0; i < 8; i++) {
+      _high = (_high << 8) | bytes[i];
+      _low = (_low << 8) | bytes[i + 8];
+    }
+  }
+
+  bool operator==(const EdgeKey& other) const {
+    return _high == other._high && _low == other._low &&
+           _port == other._port;
+  }
+
+  friend size_t hash_value(const EdgeKey& key) {
+    size_t seed = 0;
+    boost::hash_combine(seed, key._high);
+    boost::hash_combine(seed, key._low);
+    boost::hash_combine(seed, key._port);
+    return seed;
+  }
+
+  uint64_t _high;
+  uint64_t _low;
+  uint16_t _port;
+};
+
 class TestArena
   : public PlaySession::Observable {
+  friend class StatsBoard;
+
 public:
   typedef boost::asio::io_service io_service;
+  typedef boost::asio::basic_waitable_timer<
+    boost::chrono::steady_clock> steady_timer;
+
+  // concurrency targets are steered at this period
+  static const int STEER_INTERVAL_MS = 10;
+  // a search probe replaces one in this many of the sessions it inherits,
+  // so that one below the running level still times new connections
+  static const size_t PROBE_RECYCLE_SHARE = 10;
+  // an interrupted run ends this many sessions per turn of the loop, and
+  // gives up on the rest after DRAIN_TIMEOUT_MS
+  static const size_t DRAIN_BATCH = 1000;
+  static const int DRAIN_TIMEOUT_MS = 5000;
+  // a worker process publishes its stats at this period
+  static const int PUBLISH_INTERVAL_MS = 500;
+  static const int MAX_AGGREGATES = 3;
 
   TestArena()
     : _overall(new Summary())
+    , _context(this, _ioServ, _wheel, _resolver)
+    , _wheel(_ioServ)
+    , _resolver(_ioServ)
+    , _signals(_ioServ, SIGINT, SIGTERM)
+    , _spawnTimer(_ioServ)
+    , _drainTimer(_ioServ)
+    , _publishTimer(_ioServ)
+    , _slots(NULL)
+    , _slot(0)
+    , _phase(0)
+    , _phaseStart(0)
+    , _startTarget(0)
+    , _arrivals(0)
+    , _probeCarried(0)
+    , _logPending(false)
+    , _logStart(0)
+    , _logIndex(0)
+    , _startRss(0)
+    , _spawning(false)
     , _interrupted(false) {
   }
 
-  boost::shared_ptr<Summary> GetSummary(const std::string& url) {
-    if (_sums.find(url) == _sums.end()) {
-      _sums.insert(std::make_pair(
-        url, boost::shared_ptr<Summary>(new Summary())));
+  Summary* GetSummary(size_t id) {
+    if (id >= _sums.size()) {
+      _sums.resize(id + 1);
+    }
+    boost::shared_ptr<Summary>& sum = _sums[id];
+    if (!sum) {
+      sum.reset(new Summary());
     }
-    return _sums[url];
+    return sum.get();
   }
 
+  // Looked up once per connection; the session keeps the id.
+  int32_t GetEdgeId(const tcp::endpoint& endpoint) {
+    std::pair<boost::unordered_map<EdgeKey, int32_t>::iterator, bool> res =
+      _edgeIndex.insert(std::make_pair(EdgeKey(endpoint),
+                                       int32_t(_edges.size())));
+    if (res.second) {
+      _edges.push_back(boost::shared_ptr<Summary>(new Summary()));
+      _edgeEndpoints.push_back(endpoint);
+    }
+    return res.first->second;
+  }
+
+  Summary* URLSummary(const PlaySession* sess) const {
+    return _sums[sess->GetURLId()].get();
+  }
+
+  Summary* EdgeSummary(const PlaySession* sess) const {
+    int32_t id = sess->GetEdgeId();
+    return id < 0 ? NULL : _edges[id].get();
+  }
+
+  // Summaries an event is counted in besides the URL one: overall, the
+  // edge of the session and the running scenario phase.
+  size_t Aggregates(const PlaySession* sess, Summary** aggr) const {
+    size_t n = 0;
+    aggr[n++] = _overall.get();
+    if (Summary* edge = EdgeSummary(sess)) {
+      aggr[n++] = edge;
+    }
+    if (_phase < _phaseSums.size()) {
+      aggr[n++] = _phaseSums[_phase].get();
+    }
+    return n;
+  }
+
+#define FOR_AGGREGATES(sess, call) \
+  do { \
+    Summary* aggr[MAX_AGGREGATES]; \
+    for (size_t i = 0, n = Aggregates(sess, aggr); i < n; i++) { \
+      aggr[i]->call; \
+    } \
+  } while (0)
+
   virtual void OnResolved(PlaySession* sess,
                           int32_t dur) {
-    sess->GetSummary()->UpdateResolving(dur, _cfg.Detailed());
-    _overall->UpdateResolving(dur);
+    URLSummary(sess)->UpdateResolving(dur, _cfg.Detailed());
+    FOR_AGGREGATES(sess, UpdateResolving(dur));
   }
 
   virtual void OnConnected(PlaySession* sess,
                            int32_t dur) {
-    sess->GetSummary()->UpdateConnecting(dur, _cfg.Detailed());
-    _overall->UpdateConnecting(dur);
+    sess->SetEdgeId(GetEdgeId(sess->RemoteEndpoint()));
+    if (sess->ResolveMillis() >= 0) {
+      EdgeSummary(sess)->UpdateResolving(sess->ResolveMillis());
+    }
+    URLSummary(sess)->UpdateConnecting(dur, _cfg.Detailed());
+    FOR_AGGREGATES(sess, UpdateConnecting(dur));
   }
 
   virtual void OnRecvHeader(PlaySession* sess,
                             int32_t dur) {
-    sess->GetSummary()->UpdateRecvHeader(dur, _cfg.Detailed());
-    _overall->UpdateRecvHeader(dur);
+    URLSummary(sess)->UpdateRecvHeader(dur, _cfg.Detailed());
+    FOR_AGGREGATES(sess, UpdateRecvHeader(dur));
+  }
+
+  virtual void OnResponseHeader(PlaySession* sess,
+                                const HTTPResponseParser& hdr) {
+    URLSummary(sess)->UpdateResponseHeader(hdr);
+    FOR_AGGREGATES(sess, UpdateResponseHeader(hdr));
   }
 
   virtual void OnFirstChunk(PlaySession* sess,
                             int32_t dur) {
-    sess->GetSummary()->UpdateFirstChunk(dur, _cfg.Detailed());
-    _overall->UpdateFirstChunk(dur);
+    URLSummary(sess)->UpdateFirstChunk(dur, _cfg.Detailed());
+    FOR_AGGREGATES(sess, UpdateFirstChunk(dur));
   }
 
   virtual void OnContent(PlaySession* sess,
                          size_t bytes,
                          int32_t dur_in_ms) {
-    sess->GetSummary()->UpdateKBytesPerSec(bytes, dur_in_ms);
-    _overall->UpdateKBytesPerSec(bytes, dur_in_ms);
+    URLSummary(sess)->UpdateKBytesPerSec(bytes, dur_in_ms);
+    FOR_AGGREGATES(sess, UpdateKBytesPerSec(bytes, dur_in_ms));
+  }
+
+  virtual void OnStall(PlaySession* sess,
+                       int32_t gap) {
+    URLSummary(sess)->UpdateStall(gap);
+    FOR_AGGREGATES(sess, UpdateStall(gap));
+  }
+
+  virtual void OnResponse(PlaySession* sess,
+                          int32_t dur) {
+    URLSummary(sess)->UpdateResponse(dur, _cfg.Detailed());
+    FOR_AGGREGATES(sess, UpdateResponse(dur));
   }
 
   virtual void OnTotalBytes(PlaySession* sess,
                             size_t totalbytes) {
-    if (totalbytes >= _cfg.MaxRecvLength()) {
-      sess->Disconnect();
-      if (--_clients == 0) {
-        _ioServ.stop();
-      }
+    if (totalbytes >= _cfg.MaxRecvLength() ||
+        totalbytes >= sess->ByteLimit()) {
+      EndSession(sess);
     }
   }
 
   virtual void OnFinished(PlaySession* sess) {
-    sess->GetSummary()->UpdateError(HTTPPlaySession::ERROR_EARLY_EOF);
-    _overall->UpdateError(HTTPPlaySession::ERROR_EARLY_EOF);
-    sess->Disconnect();
-    if (--_clients == 0) {
-      _ioServ.stop();
+    URLSummary(sess)->UpdateError(HTTPPlaySession::ERROR_EARLY_EOF);
+    FOR_AGGREGATES(sess, UpdateError(HTTPPlaySession::ERROR_EARLY_EOF));
+    EndSession(sess);
+  }
+
+  virtual void OnCompleted(PlaySession* sess,
+                           int32_t dur) {
+    URLSummary(sess)->UpdateCompleted(dur, _cfg.Detailed());
+    FOR_AGGREGATES(sess, UpdateCompleted(dur));
+    EndSession(sess);
+  }
+
+  // Churn: the viewer leaves, and a new one takes its seat if asked to,
+  // unless the run was interrupted. Target phases refill on their own.
+  virtual void OnWatched(PlaySession* sess) {
+    URLSummary(sess)->UpdateLeft();
+    FOR_AGGREGATES(sess, UpdateLeft());
+    if (_cfg.Replace() && !_cfg.Replaying() &&
+        !_interrupted && (_spawning || !Scripted()) &&
+        (_phase >= _phases.size() || _phases[_phase].RateDriven())) {
+      CreateSession();
     }
+    EndSession(sess);
   }
 
   virtual void OnError(PlaySession* sess,
                        uint32_t ec) {
-    sess->GetSummary()->UpdateError(ec);
-    _overall->UpdateError(ec);
-    sess->Disconnect();
-    if (--_clients == 0) {
-      _ioServ.stop();
-    }
+    URLSummary(sess)->UpdateError(ec);
+    FOR_AGGREGATES(sess, UpdateError(ec));
+    EndSession(sess);
   }
 
   void SetConfig(const TestConfig& cfg) {
     _cfg = cfg;
   }
 
+  // Runs as a worker process, publishing to its slot instead of
+  // printing.
+  void SetWorker(WorkerSlots* slots, size_t slot) {
+    _slots = slots;
+    _slot = slot;
+  }
+
+  // Sessions are spawned from the io_service thread by the phase
+  // scheduler, which is the only thread touching the arena.
   void Run() {
     if (!_cfg.IsReady()) {
       return;
     }
 
-    boost::asio::signal_set signals(_ioServ, SIGINT, SIGTERM);
-    signals.async_wait(boost::bind(&TestArena::SignalHandler, this));
+    if (_cfg.GetRecvMode() == TestConfig::RECV_URING) {
+      _uring.reset(new UringReactor(_ioServ));
+      if (!_uring->Init()) {
+        std::cout << "io_uring unavailable (" << strerror(errno)
+                  << "), falling back to asio reactor\n";
+        _uring.reset();
+      }
+    }
 
-    boost::shared_ptr<io_service::work> workKeeper(
-      new io_service::work(_ioServ));
-    boost::thread workThread(boost::bind(&io_service::run, &_ioServ));
+    _signals.async_wait(boost::bind(&TestArena::SignalHandler, this,
+      boost::asio::placeholders::error));
 
-    int interval = _cfg.Interval();
-    int connects = _cfg.Clients();
-    _clients = connects;
-    TestConfig::URLIterator it = _cfg.GetURLIterator();
-    boost::chrono::time_point<boost::chrono::high_resolution_clock> start
-      = boost::chrono::high_resolution_clock::now();
+    if (!_cfg.Range().empty()) {
+      _requests.SetProfile("Range: bytes=" + _cfg.Range() + "\r\n");
+    }
 
-    for (int i = 0; i < connects && !_interrupted; ) {
-      boost::chrono::microseconds elapsed =
-        boost::chrono::duration_cast<boost::chrono::microseconds>(
-          boost::chrono::high_resolution_clock::now() - start);
-      int naptime = interval * i - elapsed.count();
-      if (naptime > 0) {
-        usleep(naptime);
-      } else {
-        std::string url = _cfg.GetNextURL(it++);
-        CreateSession(url);
-        i++;
+    _phases = _cfg.Phases();
+    _search = _cfg.Search();
+    _context._uring = _uring.get();
+    _context._dns = _search.Enabled() ? &_dns : NULL;
+    _context._timeout = _cfg.Timeout();
+    _context._requests = uint32_t(std::max(_cfg.Requests(), size_t(1)));
+    _context._drain = _cfg.GetRecvMode() == TestConfig::RECV_DRAIN;
+    _context._pipeline = _cfg.Pipelined();
+    if (Scripted()) {
+      for (size_t i = 0; i < _phases.size(); i++) {
+        _phaseSums.push_back(boost::shared_ptr<Summary>(new Summary()));
       }
     }
-    std::cout << "please wait ...\n";
-    workKeeper.reset();
-    workThread.join();
+    _urlIt = _cfg.GetURLIterator();
+    _start = boost::chrono::steady_clock::now();
+    _startRss = ResidentBytes();
+    _spawning = true;
+    if (_cfg.Replaying()) {
+      _log.reset(new AccessLog());
+      if (!_log->Open(_cfg.ReplayLog())) {
+        std::cout << "can not open access log: " << _cfg.ReplayLog() << "\n";
+        return;
+      }
+      _logPending = _log->Next(&_logEntry);
+      _logStart = _logEntry._time;
+      GetSummary(_cfg.ReplayId());
+      _ioServ.post(boost::bind(&TestArena::Replay, this,
+                               boost::system::error_code()));
+    } else {
+      _ioServ.post(boost::bind(&TestArena::Spawn, this,
+                               boost::system::error_code()));
+    }
+    if (_slots) {
+      _ioServ.post(boost::bind(&TestArena::Publish, this,
+                               boost::system::error_code()));
+    }
+    _ioServ.run();
+    if (_slots) {
+      PublishStats(true);
+    }
   }
 
   void PrintResult() const {
-    boost::unordered_map<std::string, boost::shared_ptr<Summary> >::const_iterator it;
-    for (it = _sums.begin(); it != _sums.end(); it++) {
-      const std::string& url = it->first;
-      const boost::shared_ptr<Summary>& sum = it->second;
-      std::cout << "Result for " << url << ":\n";
-      PrintOneItem(sum.get());
+    for (size_t id = 0; id < _sums.size(); id++) {
+      if (_sums[id]) {
+        std::cout << "Result for " << _cfg.GetURL(id) << ":\n";
+        PrintOneItem(_sums[id].get());
+      }
     }
 
     std::cout << "Result for all:\n";
     PrintOneItem(_overall.get());
 
+    for (size_t i = 0; i < _phaseSums.size(); i++) {
+      std::cout << "Result for " << _phases[i]._name << ":\n";
+      PrintOneItem(_phaseSums[i].get());
+    }
+
+    WorkerStats stats;
+    MemoryStats(&stats);
+    PrintMemory(stats);
+    PrintEdges();
+    PrintSearch();
+
     if (_cfg.Detailed()) {
-      boost::unordered_map<std::string, boost::shared_ptr<Summary> >::const_iterator it;
-      for (it = _sums.begin(); it != _sums.end(); it++) {
-        std::string name = it->first + ".csv";
+      for (size_t id = 0; id < _sums.size(); id++) {
+        if (!_sums[id]) {
+          continue;
+        }
+        std::string name = _cfg.GetURL(id) + ".csv";
         std::string converted = std::string(name.begin(),
           std::unique(name.begin(), name.end(), Unique));
         std::replace_if(converted.begin(), converted.end(), IsForbidden, '-');
-        const boost::shared_ptr<Summary>& sum = it->second;
         std::ofstream fs(converted.c_str());
-        sum->WriteToCSV(fs);
+        _sums[id]->WriteToCSV(fs);
       }
     }
   }
 
 protected:
 
-  void SignalHandler() {
-    std::cout << "\nInterrupting test loop\n";
-    _ioServ.stop();
+  // The first signal stops spawning and ends the running sessions, so
+  // their partial transfers still count; the second one quits at once.
+  // Workers get the signals forwarded and leave the talking to the parent.
+  void SignalHandler(const boost::system::error_code& err) {
+    if (err) {
+      return;
+    }
+    if (_interrupted) {
+      if (!_slots) {
+        std::cout << "\nQuitting, " << _sessions.size()
+                  << " sessions not drained\n";
+      }
+      _ioServ.stop();
+      return;
+    }
     _interrupted = true;
+    if (!_slots) {
+      std::cout << "\nInterrupting test loop, draining " << _sessions.size()
+                << " sessions (signal again to quit)\n";
+    }
+    _signals.async_wait(boost::bind(&TestArena::SignalHandler, this,
+      boost::asio::placeholders::error));
+    _spawning = false;
+    _spawnTimer.cancel();
+    _drainTimer.expires_from_now(
+      boost::chrono::milliseconds(DRAIN_TIMEOUT_MS));
+    _drainTimer.async_wait(boost::bind(&TestArena::DrainTimeout, this,
+      boost::asio::placeholders::error));
+    Drain();
+  }
+
+  // In batches, so that a second signal gets through a large drain.
+  void Drain() {
+    for (size_t i = 0; i < DRAIN_BATCH && !_sessions.empty(); i++) {
+      EndSession(_sessions.begin()->first);
+    }
+    if (!_sessions.empty()) {
+      _ioServ.post(boost::bind(&TestArena::Drain, this));
+    } else {
+      _ioServ.stop();
+    }
+  }
+
+  void DrainTimeout(const boost::system::error_code& err) {
+    if (err) {
+      return;
+    }
+    if (!_slots) {
+      std::cout << "Drain timed out, " << _sessions.size()
+                << " sessions not drained\n";
+    }
+    _ioServ.stop();
+  }
+
+  void Publish(const boost::system::error_code& err) {
+    if (err) {
+      return;
+    }
+    PublishStats(false);
+    _publishTimer.expires_from_now(
+      boost::chrono::milliseconds(PUBLISH_INTERVAL_MS));
+    _publishTimer.async_wait(boost::bind(&TestArena::Publish, this,
+      boost::asio::placeholders::error));
+  }
+
+  void PublishStats(bool done) {
+    WorkerStats stats;
+    stats._overall = *_overall;
+    stats._phaseCount = std::min(_phaseSums.size(), MAX_SHARED_PHASES);
+    for (size_t i = 0; i < stats._phaseCount; i++) {
+      stats._phases[i] = *_phaseSums[i];
+    }
+    stats._active = _sessions.size();
+    stats._received = _overall->_payloadBytes;
+    for (SessionMap::const_iterator it = _sessions.begin();
+         it != _sessions.end(); ++it) {
+      stats._received += it->first->PayloadBytes();
+    }
+    MemoryStats(&stats);
+    stats._done = done;
+    _slots->Publish(_slot, stats);
+  }
+
+  void MemoryStats(WorkerStats* stats) const {
+    stats->_sessionBytes = _context._peakBytes;
+    stats->_sessionsAtPeak = _context._liveAtPeak;
+    stats->_maxSessions = _context._maxLive;
+    size_t peak = PeakResidentBytes();
+    stats->_rssGrowth = peak > _startRss ? peak - _startRss : 0;
+  }
+
+  static size_t ResidentBytes() {
+    size_t pages = 0, resident = 0;
+    std::ifstream statm("/proc/self/statm");
+    statm >> pages >> resident;
+    return resident * sysconf(_SC_PAGESIZE);
+  }
+
+  static size_t PeakResidentBytes() {
+    struct rusage usage;
+    return getrusage(RUSAGE_SELF, &usage) ? 0 : usage.ru_maxrss * 1024;
+  }
+
+  // whether the phases end the sessions they leave running
+  bool Scripted() const {
+    return _cfg.HasScenario() || _search.Enabled();
+  }
+
+  double Elapsed() const {
+    return boost::chrono::duration<double>(
+      boost::chrono::steady_clock::now() - _start).count();
+  }
+
+  void NextPhase() {
+    const Phase& phase = _phases[_phase];
+    _startTarget = phase.RateDriven() ? _sessions.size() : phase._target;
+    _phaseStart += phase._duration;
+    _arrivals = 0;
+    _phase++;
+    if (_search.Enabled() && _phase == _phases.size()) {
+      NextProbe();
+    }
+  }
+
+  // Judges the probe whose hold phase just ended on its ramp and hold,
+  // then queues the next one unless the search is over.
+  void NextProbe() {
+    const Summary* ramp = _phaseSums[_phase - 2].get();
+    const Summary* hold = _phaseSums[_phase - 1].get();
+    Histogram firstChunk = ramp->_firstChunkHist;
+    firstChunk.Merge(hold->_firstChunkHist);
+
+    Probe probe;
+    probe._firstChunkP99 = firstChunk.Percentile(0.99);
+    // errors of the sessions carried over count in the phases they occur
+    probe._sessions = _probeCarried + ramp->Attempts() + hold->Attempts();
+    probe._errors = ramp->Errors() + hold->Errors();
+    probe._stalls = ramp->_stalls + hold->_stalls;
+    _search.Record(probe);
+    PrintProbe(_search.Probes().size(), _search.Probes().back());
+
+    if (!_search.Done()) {
+      _search.AddPhases(&_phases);
+      while (_phaseSums.size() < _phases.size()) {
+        _phaseSums.push_back(boost::shared_ptr<Summary>(new Summary()));
+      }
+      size_t recycle = std::min(_sessions.size(),
+        std::max(_sessions.size() / PROBE_RECYCLE_SHARE, size_t(1)));
+      for (; recycle; recycle--) {
+        EndSession(_sessions.begin()->first);
+      }
+      _probeCarried = _sessions.size();
+    }
+  }
+
+  // Brings the running phase up to date and sleeps until the next arrival
+  // is due, the next steering tick, or the end of the phase.
+  void Spawn(const boost::system::error_code& err) {
+    if (err || !_spawning) {
+      return;
+    }
+    double now = Elapsed();
+    while (_phase < _phases.size() && _phases[_phase]._duration >= 0 &&
+           now >= _phaseStart + _phases[_phase]._duration) {
+      NextPhase();
+    }
+    if (_phase == _phases.size()) {
+      StopSpawning();
+      return;
+    }
+
+    const Phase& phase = _phases[_phase];
+    double t = now - _phaseStart;
+    double wake = now + STEER_INTERVAL_MS / 1000.0;
+    if (!phase.RateDriven()) {
+      double progress = phase._duration > 0 ?
+                          std::min(t / phase._duration, 1.0) : 1.0;
+      size_t target = size_t(_startTarget +
+                             (phase._target - _startTarget) * progress + 0.5);
+      while (_sessions.size() < target && CreateSession()) {
+      }
+      while (_sessions.size() > target) {
+        EndSession(_sessions.begin()->first);
+      }
+    } else {
+      // all at once only up to a cap, nothing else would end the loop
+      size_t due = phase._rate < 0 ? (phase._sessions ? size_t(-1) : 0) :
+                   phase._rate > 0 ? size_t(t * phase._rate) + 1 : 0;
+      if (phase._sessions) {
+        due = std::min(due, phase._sessions);
+      }
+      for (; _arrivals < due; _arrivals++) {
+        CreateSession();
+      }
+      if (phase._sessions && _arrivals == phase._sessions) {
+        if (phase._duration < 0) {
+          StopSpawning();
+          return;
+        }
+        wake = _phaseStart + phase._duration;
+      } else if (phase._rate > 0) {
+        wake = _phaseStart + _arrivals / phase._rate;
+      } else {
+        wake = _phaseStart + phase._duration;
+      }
+    }
+    if (phase._duration >= 0) {
+      wake = std::min(wake, _phaseStart + phase._duration);
+    }
+
+    _spawnTimer.expires_at(_start + boost::chrono::duration_cast<
+      boost::chrono::steady_clock::duration>(
+        boost::chrono::duration<double>(wake)));
+    _spawnTimer.async_wait(boost::bind(&TestArena::Spawn, this,
+      boost::asio::placeholders::error));
+  }
+
+  double ReplayTime(const AccessLog::Entry& entry) const {
+    return (entry._time - _logStart) / _cfg.ReplaySpeedup();
+  }
+
+  // Opens the sessions of every log entry that is due, then sleeps until
+  // the next one; only one entry is held in memory.
+  void Replay(const boost::system::error_code& err) {
+    if (err || !_spawning) {
+      return;
+    }
+    double now = Elapsed();
+    while (_logPending && ReplayTime(_logEntry) <= now) {
+      // workers take turns on the entries
+      if (_logIndex++ % _cfg.SliceCount() == _cfg.SliceIndex()) {
+        ReplayEntry(_logEntry);
+      }
+      _logPending = _log->Next(&_logEntry);
+    }
+    if (!_logPending) {
+      if (_log->Skipped() && !_slots) {
+        std::cout << _log->Skipped() << " access log lines skipped\n";
+      }
+      StopSpawning();
+      return;
+    }
+    _spawnTimer.expires_at(_start + boost::chrono::duration_cast<
+      boost::chrono::steady_clock::duration>(
+        boost::chrono::duration<double>(ReplayTime(_logEntry))));
+    _spawnTimer.async_wait(boost::bind(&TestArena::Replay, this,
+      boost::asio::placeholders::error));
+  }
+
+  // A viewer becomes scale sessions, the fraction drawn at random, which
+  // keep the logged watch time (sped up) or bytes.
+  void ReplayEntry(const AccessLog::Entry& entry) {
+    double scale = _cfg.ReplayScale();
+    size_t count = size_t(scale);
+    if (_cfg.Random().Uniform() < scale - count) {
+      count++;
+    }
+    urdl::url url(entry._url);
+    for (size_t i = 0; i < count; i++) {
+      PlaySession* sess = CreateSession(_cfg.ReplayId(), url);
+      if (!sess) {
+        continue;
+      }
+      if (entry._duration >= 0) {
+        sess->SetWatchTime(int32_t(std::min(
+          entry._duration * 1000 / _cfg.ReplaySpeedup(), 2e9)));
+      }
+      if (entry._bytes >= 0) {
+        sess->SetByteLimit(entry._bytes);
+      }
+    }
+  }
+
+  // A scenario or search ends its sessions with its last phase, a plain
+  // run lets them finish.
+  void StopSpawning() {
+    _spawning = false;
+    if (!_slots) {
+      std::cout << "please wait ...\n";
+    }
+    if (Scripted()) {
+      while (!_sessions.empty()) {
+        EndSession(_sessions.begin()->first);
+      }
+    }
+    if (_sessions.empty()) {
+      _ioServ.stop();
+    }
+  }
+
+  // Dropping the session is deferred, it may be ending from a call made
+  // by itself that still runs on its members.
+  void EndSession(PlaySession* sess) {
+    SessionMap::iterator it = _sessions.find(sess);
+    if (it == _sessions.end()) {
+      return;
+    }
+    sess->FlushStats();
+    URLSummary(sess)->UpdateTransfer(sess->PayloadBytes(),
+                                     sess->OverheadBytes());
+    FOR_AGGREGATES(sess, UpdateTransfer(sess->PayloadBytes(),
+                                        sess->OverheadBytes()));
+    sess->Disconnect();
+    _ioServ.post(boost::bind(&TestArena::Release, it->second));
+    _sessions.erase(it);
+    if (!_spawning && _sessions.empty()) {
+      _ioServ.stop();
+    }
+  }
+
+#undef FOR_AGGREGATES
+
+  static void Release(const boost::shared_ptr<PlaySession>&) {
+  }
+
+  // Worst edges first: by p99 first chunk time, then by error rate.
+  struct EdgeRank {
+    EdgeRank(const std::vector<boost::shared_ptr<Summary> >& edges)
+      : _edges(edges) {
+    }
+    bool operator()(size_t l, size_t r) const {
+      int64_t lp = _edges[l]->_firstChunkHist.Percentile(0.99);
+      int64_t rp = _edges[r]->_firstChunkHist.Percentile(0.99);
+      if (lp != rp) {
+        return lp > rp;
+      }
+      return ErrorRate(_edges[l].get()) > ErrorRate(_edges[r].get());
+    }
+    const std::vector<boost::shared_ptr<Summary> >& _edges;
+  };
+
+  static double ErrorRate(const Summary* sum) {
+    size_t sessions = sum->_connecting._den;
+    return sessions ? 100.0 * sum->Errors() / sessions : 0.0;
+  }
+
+  static std::string Percentile(const Histogram& hist, double q) {
+    int64_t value = hist.Percentile(q);
+    if (value < 0) {
+      return std::string("-");
+    }
+    std::stringstream stream;
+    stream << value;
+    return stream.str();
+  }
+
+  void PrintEdges() const {
+    if (_edges.empty()) {
+      return;
+    }
+    std::vector<size_t> order(_edges.size());
+    for (size_t i = 0; i < order.size(); i++) {
+      order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), EdgeRank(_edges));
+
+    std::cout << "Result by edge (worst p99 first_chunk first):\n";
+    for (size_t i = 0; i < order.size(); i++) {
+      const Summary* sum = _edges[order[i]].get();
+      std::stringstream rate;
+      rate.setf(std::ios::fixed);
+      rate.precision(2);
+      rate << ErrorRate(sum);
+      std::cout << "  " << _edgeEndpoints[order[i]]
+        << "  sessions: " << sum->_connecting._den
+        << "  resolve (avg): " << sum->_resolving.Value() << " (ms)"
+        << "  connect (avg/p99): "
+          << sum->_connecting.Value() << "/"
+          << Percentile(sum->_connectHist, 0.99) << " (ms)"
+        << "  recvhdr (avg): " << sum->_recvHeader.Value() << " (ms)"
+        << "  first_chunk (avg/p99): "
+          << sum->_firstChunk.Value() << "/"
+          << Percentile(sum->_firstChunkHist, 0.99) << " (ms)"
+        << "  bps (avg): " << sum->_kBytesPerSec.Value() << " (KB/s)"
+        << "  errors: " << sum->Errors() << " (" << rate.str() << "%)"
+        << std::endl;
+    }
+  }
+
+  static void PrintProbe(size_t n, const Probe& probe) {
+    std::stringstream rate;
+    rate.setf(std::ios::fixed);
+    rate.precision(2);
+    rate << probe.ErrorRate();
+    std::stringstream p99;
+    if (probe._firstChunkP99 < 0) {
+      p99 << "-";
+    } else {
+      p99 << probe._firstChunkP99;
+    }
+    std::cout << "  probe " << n << ": " << probe._level << " sessions"
+      << "  first_chunk (p99): " << p99.str() << " (ms)"
+      << "  errors: " << probe._errors << "/" << probe._sessions
+        << " (" << rate.str() << "%)"
+      << "  stalls: " << probe._stalls
+      << "  " << (probe._pass ? "pass" : "fail")
+      << std::endl;
+  }
+
+  void PrintSearch() const {
+    if (!_search.Enabled()) {
+      return;
+    }
+    std::cout << "Capacity search (" << _search.Objective().Describe()
+              << "):\n";
+    const std::vector<Probe>& probes = _search.Probes();
+    for (size_t i = 0; i < probes.size(); i++) {
+      PrintProbe(i + 1, probes[i]);
+    }
+    std::cout << "  knee: ";
+    if (_search.Knee()) {
+      std::cout << _search.Knee() << " sessions";
+    } else {
+      std::cout << "none, the lowest level fails";
+    }
+    if (_search.FirstFailing()) {
+      std::cout << "  first failing: " << _search.FirstFailing()
+                << " sessions";
+    }
+    if (!_search.Done()) {
+      std::cout << "  (search interrupted)";
+    }
+    std::cout << std::endl;
   }
 
   static bool IsForbidden(char c) {
@@ -352,6 +1193,22 @@ protected:
     return IsForbidden(l) && IsForbidden(r);
   }
 
+  // Session state and buffers at their peak, and the growth of the peak
+  // RSS, which adds the sockets, the reactor and the allocator; both per
+  // session.
+  static void PrintMemory(const WorkerStats& stats) {
+    if (!stats._sessionsAtPeak || !stats._maxSessions) {
+      return;
+    }
+    std::cout << "Memory per session: "
+      << stats._sessionBytes / stats._sessionsAtPeak
+      << " bytes held by the session (" << stats._sessionBytes
+      << " for " << stats._sessionsAtPeak << " sessions at the peak), "
+      << stats._rssGrowth / stats._maxSessions << " bytes of RSS ("
+      << stats._rssGrowth << " for " << stats._maxSessions
+      << " sessions at most)" << std::endl;
+  }
+
   static void PrintOneItem(const Summary* sum) {
     std::cout << "  resolve (avg/max/min): "
       << sum->_resolving.Value() << "/"
@@ -365,15 +1222,24 @@ protected:
       << sum->_recvHeader.Value() << "/"
       << sum->_recvHeader.Max() << "/"
       << sum->_recvHeader.Min() << " (ms)"
-    << "  first_chunk (avg/max/min): "
+    << "  first_chunk (avg/max/min/p99): "
       << sum->_firstChunk.Value() << "/"
       << sum->_firstChunk.Max() << "/"
-      << sum->_firstChunk.Min() << " (ms)"
+      << sum->_firstChunk.Min() << "/"
+      << Percentile(sum->_firstChunkHist, 0.99) << " (ms)"
+    << "  response (avg/max/min): "
+      << sum->_response.Value() << "/"
+      << sum->_response.Max() << "/"
+      << sum->_response.Min() << " (ms)"
+    << "  download (avg/max/min): "
+      << sum->_download.Value() << "/"
+      << sum->_download.Max() << "/"
+      << sum->_download.Min() << " (ms)"
     << "  bps (avg/max/min): "
       << sum->_kBytesPerSec.Value() << "/"
       << sum->_kBytesPerSec.Max() << "/"
       << sum->_kBytesPerSec.Min() << " (KB/s)"
-    << "  err (resolve/connect/request/recv/bad_http/timeout/early_eof): "
+    << "  err (resolve/connect/request/recv/bad_http/timeout/early_eof/bad_chunked/truncated/closed_early): "
 #define ERRORCOUNT(x) sum->_errors[(x) - HTTPPlaySession::ERROR_BASE]
       << ERRORCOUNT(HTTPPlaySession::ERROR_ON_RESOLVE) << "/"
       << ERRORCOUNT(HTTPPlaySession::ERROR_ON_CONNECT) << "/"
@@ -381,29 +1247,108 @@ protected:
       << ERRORCOUNT(HTTPPlaySession::ERROR_ON_RECV) << "/"
       << ERRORCOUNT(HTTPPlaySession::ERROR_BAD_HTTP) << "/"
       << ERRORCOUNT(HTTPPlaySession::ERROR_TIMEOUT_FOR_NO_DATA) << "/"
-      << ERRORCOUNT(HTTPPlaySession::ERROR_EARLY_EOF)
+      << ERRORCOUNT(HTTPPlaySession::ERROR_EARLY_EOF) << "/"
+      << ERRORCOUNT(HTTPPlaySession::ERROR_BAD_CHUNKED) << "/"
+      << ERRORCOUNT(HTTPPlaySession::ERROR_TRUNCATED_BODY) << "/"
+      << ERRORCOUNT(HTTPPlaySession::ERROR_CLOSED_EARLY)
 #undef ERRORCOUNT
+    << "  body (length/chunked/close/partial): "
+      << sum->_sizedBodies << "/"
+      << sum->_chunkedBodies << "/"
+      << sum->_closeBodies << "/"
+      << sum->_partialBodies
+    << "  completed: " << sum->_completed
+    << "  left: " << sum->_left
+    << "  stalls: " << sum->_stalls
+    << "  stall gap (avg/max/min): "
+      << sum->_stallGap.Value() << "/"
+      << sum->_stallGap.Max() << "/"
+      << sum->_stallGap.Min() << " (ms)"
+    << "  bytes (payload/framing): "
+      << sum->_payloadBytes << "/"
+      << sum->_overheadBytes
+    << "  server: " << sum->_servers.Value()
+    << "  content-type: " << sum->_contentTypes.Value()
     << std::endl;
   }
 
-  PlaySession* CreateSession(const std::string& u) {
-    urdl::url url(u);
+  bool CreateSession() {
+    size_t id = _cfg.GetNextURLId(_urlIt++);
+    const urdl::url* interned = _cfg.InternedURL(id);
+    PlaySession* sess = interned ? CreateSession(id, *interned) :
+      CreateSession(_cfg.SummaryId(id), urdl::url(_cfg.NextURL(id)));
+    if (sess && _cfg.GetWatchTime().Enabled()) {
+      double seconds = _cfg.GetWatchTime().Sample(_cfg.Random());
+      sess->SetWatchTime(int32_t(std::min(seconds * 1000, 2e9)));
+    }
+    return sess != NULL;
+  }
+
+  PlaySession* CreateSession(size_t id, const urdl::url& url) {
+    boost::shared_ptr<PlaySession> sess;
     if (url.protocol() == "rtmp") {
-      //return new RTMPPlaySession(&_ioServ);
-      return NULL;
+      //sess.reset(new RTMPPlaySession(&_ioServ));
     } else if (url.protocol() == "http") {
-      return new HTTPPlaySession(this, _ioServ, GetSummary(u), url, _cfg.Timeout());
+      GetSummary(id);
+      // object and count in one allocation
+      sess = boost::make_shared<HTTPPlaySession>(boost::ref(_context), id,
+                                                 _cfg.IsGenerated(id) ?
+                                                   _requests.Make(url) :
+                                                   _requests.Get(id, url));
+    }
+    if (!sess) {
+      return NULL;
     }
-    return NULL;
+    sess->SetStallTime(_cfg.StallMillis());
+    _sessions[sess.get()] = sess;
+    sess->Start(url);
+    return sess.get();
   }
 
 private:
+  typedef boost::unordered_map<PlaySession*,
+                               boost::shared_ptr<PlaySession> > SessionMap;
+
   boost::shared_ptr<Summary> _overall;
-  boost::unordered_map<std::string, boost::shared_ptr<Summary> > _sums;
+  std::vector<boost::shared_ptr<Summary> > _sums;
+  boost::unordered_map<EdgeKey, int32_t> _edgeIndex;
+  std::vector<boost::shared_ptr<Summary> > _edges;
+  std::vector<tcp::endpoint> _edgeEndpoints;
+  std::vector<boost::shared_ptr<Summary> > _phaseSums;
+  HTTPRequestCache _requests;
+  ResolveCache _dns;
+  // before the io_service: sessions it still holds when destroyed
+  // account for themselves here
+  HTTPSessionContext _context;
   io_service _ioServ;
+  TimingWheel _wheel;
+  tcp::resolver _resolver;
+  boost::scoped_ptr<UringReactor> _uring;
   TestConfig _cfg;
+  TestConfig::URLIterator _urlIt;
+  SessionMap _sessions;
+  boost::asio::signal_set _signals;
+  steady_timer _spawnTimer;
+  steady_timer _drainTimer;
+  steady_timer _publishTimer;
+  WorkerSlots* _slots;
+  size_t _slot;
+  boost::chrono::steady_clock::time_point _start;
+  std::vector<Phase> _phases;
+  size_t _phase;
+  double _phaseStart;
+  double _startTarget;
+  size_t _arrivals;
+  size_t _probeCarried;
+  boost::scoped_ptr<AccessLog> _log;
+  AccessLog::Entry _logEntry;
+  bool _logPending;
+  double _logStart;
+  size_t _logIndex;
+  size_t _startRss;
+  CapacitySearch _search;
+  bool _spawning;
   bool _interrupted;
-  int _clients;
 };
 
 #endif // TEST_ARENA_HH_INCLUDED
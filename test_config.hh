@@ -1,12 +1,24 @@
 #ifndef TEST_CONFIG_HH_INCLUDED
 #define TEST_CONFIG_HH_INCLUDED
 
+#include <fstream>
+#include <sstream>
 #include <string>
+#include <vector>
 #include <boost/foreach.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/chrono/include.hpp>
+#include <boost/unordered_map.hpp>
 #include <boost/program_options.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/json_parser.hpp>
+#include <boost/smart_ptr.hpp>
+#include "access_log.hh"
+#include "capacity_search.hh"
+#include "scenario.hh"
+#include "url_file.hh"
+#include "url_template.hh"
+#include "url.hpp"
 
 using namespace boost::program_options;
 
@@ -14,13 +26,42 @@ class TestConfig {
 public:
   static const int DEFAULT_RECV_LENGTH = 8 * 1024 * 1024;
 
+  enum RecvMode {
+    RECV_BLOCK,
+    RECV_DRAIN,
+    RECV_URING,
+  };
+
+  enum SelectPolicy {
+    SELECT_RR,
+    SELECT_RANDOM,
+    SELECT_WEIGHTED,
+    SELECT_ZIPF,
+  };
+
   TestConfig()
     : _ready(false)
     , _clients(1)
     , _recvLen(DEFAULT_RECV_LENGTH)
     , _interval(0)
     , _timeout(10)
-    , _detail(false) {
+    , _detail(false)
+    , _recvMode(RECV_BLOCK)
+    , _requests(1)
+    , _pipeline(false)
+    , _select(SELECT_RR)
+    , _zipfExponent(1.0)
+    , _entries(0)
+    , _scenario(false)
+    , _replace(false)
+    , _replayId(0)
+    , _fileId(0)
+    , _speedup(1.0)
+    , _scale(1.0)
+    , _procs(1)
+    , _sliceIndex(0)
+    , _sliceCount(1)
+    , _configLoaded(false) {
   }
 
   TestConfig(int argc, char* argv[])
@@ -29,8 +70,56 @@ public:
     , _recvLen(DEFAULT_RECV_LENGTH)
     , _interval(0)
     , _timeout(10)
-    , _detail(false) {
-      Prepare(argc, argv);
+    , _detail(false)
+    , _recvMode(RECV_BLOCK)
+    , _requests(1)
+    , _pipeline(false)
+    , _select(SELECT_RR)
+    , _zipfExponent(1.0)
+    , _entries(0)
+    , _scenario(false)
+    , _replace(false)
+    , _replayId(0)
+    , _fileId(0)
+    , _speedup(1.0)
+    , _scale(1.0)
+    , _procs(1)
+    , _sliceIndex(0)
+    , _sliceCount(1)
+    , _args(argv + 1, argv + argc)
+    , _configLoaded(false) {
+      Prepare();
+  }
+
+  // As an agent is handed it: the controller's arguments, and the text of
+  // the config file they name, read there.
+  TestConfig(const std::vector<std::string>& args,
+             const std::string& configText)
+    : _ready(false)
+    , _clients(1)
+    , _recvLen(DEFAULT_RECV_LENGTH)
+    , _interval(0)
+    , _timeout(10)
+    , _detail(false)
+    , _recvMode(RECV_BLOCK)
+    , _requests(1)
+    , _pipeline(false)
+    , _select(SELECT_RR)
+    , _zipfExponent(1.0)
+    , _entries(0)
+    , _scenario(false)
+    , _replace(false)
+    , _replayId(0)
+    , _fileId(0)
+    , _speedup(1.0)
+    , _scale(1.0)
+    , _procs(1)
+    , _sliceIndex(0)
+    , _sliceCount(1)
+    , _args(args)
+    , _configText(configText)
+    , _configLoaded(true) {
+      Prepare();
   }
 
   bool IsReady() const {
@@ -61,47 +150,268 @@ public:
     return _detail;
   }
 
+  RecvMode GetRecvMode() const {
+    return _recvMode;
+  }
+
+  size_t Requests() const {
+    return _requests;
+  }
+
+  bool Pipelined() const {
+    return _pipeline;
+  }
+
+  const WatchTime& GetWatchTime() const {
+    return _watch;
+  }
+
+  // replace a viewer leaving after its watch time by a new one
+  bool Replace() const {
+    return _replace;
+  }
+
+  // Draws from the test's shared generator.
+  FastRandom& Random() {
+    return _random;
+  }
+
+  bool HasScenario() const {
+    return _scenario;
+  }
+
+  // The scenario phases, the first probe of a search, or the single phase
+  // spawning clients sessions interval microseconds apart.
+  const std::vector<Phase>& Phases() const {
+    return _phases;
+  }
+
+  // "first-last" byte range requested from every URL, empty for none
+  const std::string& Range() const {
+    return _range;
+  }
+
   class URLIterator {
   public:
-    URLIterator(size_t total) : _totalURL(total) {}
+    URLIterator(size_t start = 0, size_t stride = 1)
+      : _counter(start)
+      , _stride(stride) {
+    }
 
-    URLIterator& operator++(int) {
-      _counter ++;
-      return *this;
+    URLIterator operator++(int) {
+      URLIterator prev = *this;
+      _counter += _stride;
+      return prev;
     }
 
     operator size_t() const {
-      return _counter % _totalURL;
+      return _counter;
     }
 
   private:
     size_t _counter;
-    size_t _totalURL;
+    size_t _stride;
   };
 
   URLIterator GetURLIterator() const {
-    return URLIterator(_urlVec.size());
+    return URLIterator(_sliceIndex, _sliceCount);
+  }
+
+  size_t Procs() const {
+    return _procs;
+  }
+
+  // "[host:]port" to serve controllers on, empty when not an agent
+  const std::string& AgentAddress() const {
+    return _agent;
+  }
+
+  // "host:port" of the agents to drive, none when not a controller
+  const std::vector<std::string>& Controlled() const {
+    return _controlled;
+  }
+
+  // The arguments an agent runs this test with: these, less the ones
+  // choosing the mode.
+  const std::vector<std::string>& AgentArgs() const {
+    return _agentArgs;
+  }
+
+  const std::string& ConfigText() const {
+    return _configText;
+  }
+
+  // which of how many worker processes this configuration runs as
+  size_t SliceIndex() const {
+    return _sliceIndex;
+  }
+
+  size_t SliceCount() const {
+    return _sliceCount;
+  }
+
+  // Makes this the share of worker index out of count: arrival rates,
+  // targets and caps are divided among the workers, which take turns on
+  // the URL list and on template counters and draw their own randoms.
+  // Slicing a slice again splits it further.
+  void Slice(size_t index, size_t count) {
+    _sliceIndex += index * _sliceCount;
+    _sliceCount *= count;
+    for (size_t i = 0; i < _phases.size(); i++) {
+      Phase& phase = _phases[i];
+      if (phase._target > 0) {
+        double share = std::floor(phase._target / count);
+        phase._target = share + (index < phase._target - share * count);
+      }
+      if (phase._rate > 0) {
+        phase._rate /= count;
+      }
+      if (phase._sessions) {
+        phase._sessions = phase._sessions / count +
+                          (index < phase._sessions % count);
+        if (!phase._sessions) {
+          // nothing left to this worker; 0 would mean no cap
+          if (phase._duration < 0) {
+            phase._duration = 0;
+          } else {
+            phase._rate = 0;
+          }
+        }
+      }
+    }
+    for (size_t id = 0; id < _templates.size(); id++) {
+      if (_templates[id]) {
+        _templates[id]->Slice(index, count);
+      }
+    }
+    _random.Seed(_random.Next() + index);
   }
 
-  std::string GetNextURL(const URLIterator& it) const {
+  // Id of the URL to play next, picked among the entries by the selection
+  // policy. Entries are the inline URLs as listed, then the URL file
+  // lines; ids are dense, one per distinct inline URL, then one per file
+  // line. Round-robin indexes the file only as far as it got until it
+  // wraps, the other policies need the whole count up front.
+  size_t GetNextURLId(const URLIterator& it) {
+    size_t listed = _urlIds.size();
     size_t i = it;
-    size_t total = _urlVec.size();
-    if (!total)
-      return std::string();
-    return _urlVec[i % total];
+    switch (_select) {
+    case SELECT_RR:
+      if (!_urlFile) {
+        i %= listed;
+      } else if (i >= listed && !_urlFile->Has(i - listed)) {
+        i %= listed + _urlFile->Count();
+      }
+      break;
+    case SELECT_RANDOM:
+      i = _random.Below(_entries);
+      break;
+    case SELECT_WEIGHTED:
+    case SELECT_ZIPF:
+      i = _alias->Sample(_random);
+      break;
+    }
+    return i < listed ? _urlIds[i] : _urlVec.size() + (i - listed);
+  }
+
+  // The URL, or the template text for a template id.
+  std::string GetURL(size_t id) const {
+    if (id < _urlVec.size()) {
+      return _urlVec[id];
+    }
+    return _urlFile->Entry(id - _urlVec.size());
+  }
+
+  // Parsed at load for the inline URLs; NULL for templates and the URL
+  // file or replay log, whose sessions each play a URL of their own.
+  const urdl::url* InternedURL(size_t id) const {
+    return id < _parsedURLs.size() && !IsTemplate(id) ?
+             &_parsedURLs[id] : NULL;
+  }
+
+  bool IsTemplate(size_t id) const {
+    return id < _templates.size() && _templates[id];
+  }
+
+  // Whether sessions of this id each play a URL of their own.
+  bool IsGenerated(size_t id) const {
+    return IsTemplate(id) || (Replaying() && id == _replayId) ||
+           (_urlFile && id == _fileId);
+  }
+
+  // Id a session of this URL id is summarized under: URL file lines all
+  // share one, however long the file.
+  size_t SummaryId(size_t id) const {
+    return id < _urlVec.size() ? id : _fileId;
+  }
+
+  bool Replaying() const {
+    return !_replay.empty();
+  }
+
+  const std::string& ReplayLog() const {
+    return _replay;
+  }
+
+  // id all replayed sessions are summarized under
+  size_t ReplayId() const {
+    return _replayId;
+  }
+
+  double ReplaySpeedup() const {
+    return _speedup;
+  }
+
+  double ReplayScale() const {
+    return _scale;
+  }
+
+  // the concurrency search, if enabled, with the SLO it probes against
+  const CapacitySearch& Search() const {
+    return _search;
+  }
+
+  // gap in a session's data reported as a stall
+  int32_t StallMillis() const {
+    return _search.Objective()._stallMs;
+  }
+
+  // The URL a new session of this id plays; templates expand afresh.
+  std::string NextURL(size_t id) {
+    if (IsTemplate(id)) {
+      return _templates[id]->Expand(_random);
+    }
+    return GetURL(id);
   }
 
 protected:
-  void Prepare(int argc, char* argv[]) {
+  void Prepare() {
     options_description opt;
     opt.add_options()
       ("clients,n", value<size_t>(), "number of testing clients")
       ("recvlen,r", value<size_t>(), "max content length should be received (bytes)")
       ("interval,i", value<int32_t>(), "interval of connection (us)")
       ("urls,u", value<std::string>(), "testing url")
+      ("urlfile,f", value<std::string>(), "file of testing urls, one per line")
       ("timeout,t", value<int32_t>(), "max timeout for no-data-duration (s)")
       ("config,c", value<std::string>(), "input json config")
-      ("detail,d", "produce detailed statistic data (in csv format)");
+      ("detail,d", "produce detailed statistic data (in csv format)")
+      ("recvmode,m", value<std::string>(), "content receive engine (block|drain|uring)")
+      ("requests,q", value<size_t>(), "requests issued on each keep-alive connection")
+      ("pipeline,p", "pipeline the requests of a connection")
+      ("range", value<std::string>(), "request a byte range (first-last)")
+      ("select,s", value<std::string>(), "url selection (rr|random|weighted|zipf[:exponent])")
+      ("watch,w", value<std::string>(), "watch time in seconds (exp:mean|lognormal:mu,sigma|cdf:file)")
+      ("replace", "replace viewers leaving after their watch time")
+      ("replay,l", value<std::string>(), "replay viewers from an access log (time url [bytes|Ns])")
+      ("speedup", value<double>(), "replay speed-up factor")
+      ("scale", value<double>(), "sessions per replayed viewer")
+      ("search", value<std::string>(), "search the highest concurrency meeting the slo (step:min,max,step|binary:min,max[,resolution])")
+      ("probe", value<std::string>(), "seconds each search probe holds its level, after a ramp (hold[,ramp])")
+      ("slo", value<std::string>(), "service level of the search (first_chunk_p99=ms,errors=percent,stalls=n,stall=ms)")
+      ("procs", value<size_t>(), "worker processes sharing the load")
+      ("agent", value<std::string>(), "serve a controller, running the tests it sends ([host:]port, host 127.0.0.1 unless given)")
+      ("controller", value<std::string>(), "run the test on these agents (host:port,...)");
 
     std::stringstream ss;
     ss << "perftest [OPTION]...\n";
@@ -110,18 +420,45 @@ protected:
 
     variables_map vmap;
     try {
-      store(parse_command_line(argc, argv, opt), vmap);
+      parsed_options parsed = command_line_parser(_args).options(opt).run();
+      store(parsed, vmap);
       notify(vmap);
+      BOOST_FOREACH (const option& o, parsed.options) {
+        if (o.string_key != "agent" && o.string_key != "controller") {
+          _agentArgs.insert(_agentArgs.end(), o.original_tokens.begin(),
+                            o.original_tokens.end());
+        }
+      }
     } catch (std::exception& ex) {
       return;
     }
 
+    // the test comes later, from the controller
+    if (vmap.count("agent")) {
+      _agent = vmap["agent"].as<std::string>();
+      _ready = !vmap.count("controller");
+      return;
+    }
+    if (vmap.count("controller")) {
+      SplitURLs(vmap["controller"].as<std::string>(), &_controlled);
+    }
+
     std::vector<std::string> urlVec1, urlVec2;
+    std::vector<double> weights1;
+    std::string urlFile;
     if (vmap.count("config")) {
       std::string cfgFile = vmap["config"].as<std::string>();
+      if (!_configLoaded) {
+        std::ifstream file(cfgFile.c_str());
+        std::stringstream text;
+        text << file.rdbuf();
+        _configText = text.str();
+        _configLoaded = true;
+      }
       try {
         boost::property_tree::ptree root;
-        boost::property_tree::json_parser::read_json(cfgFile, root);
+        std::istringstream text(_configText);
+        boost::property_tree::json_parser::read_json(text, root);
         if (root.find("clients") != root.not_found()) {
           _clients = root.get<size_t>("clients");
         }
@@ -134,15 +471,85 @@ protected:
         if (root.find("urls") != root.not_found()) {
           BOOST_FOREACH (boost::property_tree::ptree::value_type& url
                , root.get_child("urls")) {
-            urlVec1.push_back(url.second.data());
+            // either "url" or {"url": "...", "weight": w}
+            if (url.second.empty()) {
+              urlVec1.push_back(url.second.data());
+              weights1.push_back(1.0);
+            } else {
+              urlVec1.push_back(url.second.get<std::string>("url", ""));
+              weights1.push_back(url.second.get<double>("weight", 1.0));
+            }
           }
         }
+        if (root.find("urlfile") != root.not_found()) {
+          urlFile = root.get<std::string>("urlfile");
+        }
         if (root.find("timeout") != root.not_found()) {
           _timeout = root.get<int32_t>("timeout");
         }
         if (root.find("detail") != root.not_found()) {
           _detail = root.get<bool>("detail");
         }
+        if (root.find("requests") != root.not_found()) {
+          _requests = root.get<size_t>("requests");
+        }
+        if (root.find("pipeline") != root.not_found()) {
+          _pipeline = root.get<bool>("pipeline");
+        }
+        if (root.find("range") != root.not_found()) {
+          _range = root.get<std::string>("range");
+        }
+        if (root.find("recvmode") != root.not_found()) {
+          if (!ParseRecvMode(root.get<std::string>("recvmode"))) {
+            return;
+          }
+        }
+        if (root.find("scenario") != root.not_found()) {
+          if (!ParseScenario(root.get_child("scenario"), &_phases)) {
+            return;
+          }
+          _scenario = true;
+        }
+        if (root.find("watch") != root.not_found()) {
+          if (!ParseWatchTime(root.get<std::string>("watch"))) {
+            return;
+          }
+        }
+        if (root.find("replace") != root.not_found()) {
+          _replace = root.get<bool>("replace");
+        }
+        if (root.find("replay") != root.not_found()) {
+          _replay = root.get<std::string>("replay");
+        }
+        if (root.find("speedup") != root.not_found()) {
+          _speedup = root.get<double>("speedup");
+        }
+        if (root.find("scale") != root.not_found()) {
+          _scale = root.get<double>("scale");
+        }
+        if (root.find("search") != root.not_found()) {
+          if (!ParseSearch(root.get<std::string>("search"))) {
+            return;
+          }
+        }
+        if (root.find("probe") != root.not_found()) {
+          if (!ParseProbe(root.get<std::string>("probe"))) {
+            return;
+          }
+        }
+        if (root.find("slo") != root.not_found()) {
+          if (!ParseSLO(root.get<std::string>("slo"))) {
+            return;
+          }
+        }
+        if (root.find("procs") != root.not_found()) {
+          _procs = root.get<size_t>("procs");
+        }
+        if (root.find("select") != root.not_found()) {
+          if (!ParseSelectPolicy(root.get<std::string>("select"))) {
+            return;
+          }
+        }
       } catch (boost::property_tree::json_parser::json_parser_error& err) {
         std::cout << "error when parsing " << cfgFile << "\n";
       }
@@ -157,9 +564,10 @@ protected:
       _interval = vmap["interval"].as<int32_t>();
     }
     if (vmap.count("urls")) {
-      std::string urls = vmap["urls"].as<std::string>();
-      boost::split(urlVec2, urls, boost::is_any_of(",  \n\t"),
-                   boost::token_compress_on);
+      SplitURLs(vmap["urls"].as<std::string>(), &urlVec2);
+    }
+    if (vmap.count("urlfile")) {
+      urlFile = vmap["urlfile"].as<std::string>();
     }
     if (vmap.count("timeout")) {
       _timeout = vmap["timeout"].as<int32_t>();
@@ -167,22 +575,344 @@ protected:
     if (vmap.count("detail")) {
       _detail = true;
     }
+    if (vmap.count("requests")) {
+      _requests = vmap["requests"].as<size_t>();
+    }
+    if (vmap.count("pipeline")) {
+      _pipeline = true;
+    }
+    if (vmap.count("range")) {
+      _range = vmap["range"].as<std::string>();
+    }
+    if (vmap.count("recvmode")) {
+      if (!ParseRecvMode(vmap["recvmode"].as<std::string>())) {
+        return;
+      }
+    }
+    if (vmap.count("select")) {
+      if (!ParseSelectPolicy(vmap["select"].as<std::string>())) {
+        return;
+      }
+    }
+    if (vmap.count("watch")) {
+      if (!ParseWatchTime(vmap["watch"].as<std::string>())) {
+        return;
+      }
+    }
+    if (vmap.count("replace")) {
+      _replace = true;
+    }
+    if (vmap.count("replay")) {
+      _replay = vmap["replay"].as<std::string>();
+    }
+    if (vmap.count("speedup")) {
+      _speedup = vmap["speedup"].as<double>();
+    }
+    if (vmap.count("scale")) {
+      _scale = vmap["scale"].as<double>();
+    }
+    if (vmap.count("procs")) {
+      _procs = vmap["procs"].as<size_t>();
+    }
+    if (vmap.count("search")) {
+      if (!ParseSearch(vmap["search"].as<std::string>())) {
+        return;
+      }
+    }
+    if (vmap.count("probe")) {
+      if (!ParseProbe(vmap["probe"].as<std::string>())) {
+        return;
+      }
+    }
+    if (vmap.count("slo")) {
+      if (!ParseSLO(vmap["slo"].as<std::string>())) {
+        return;
+      }
+    }
+
+    InternURLs(urlVec1, weights1);
+    InternURLs(urlVec2, std::vector<double>());
+    if (!ParseTemplates() || !ParseURLs()) {
+      return;
+    }
+    _random.Seed(
+      boost::chrono::steady_clock::now().time_since_epoch().count());
+
+    if (!urlFile.empty()) {
+      _urlFile.reset(new URLFile());
+      if (!_urlFile->Open(urlFile)) {
+        std::cout << "can not open url file: " << urlFile << "\n";
+        return;
+      }
+      if (!_urlFile->Has(0)) {
+        _urlFile.reset();
+      } else {
+        _fileId = _urlVec.size();
+        _urlVec.push_back("urlfile:" + urlFile);
+      }
+    }
+    if (Replaying()) {
+      if (_scenario || _speedup <= 0 || _scale < 0) {
+        std::cout << "replay needs a positive speedup and scale, "
+                     "and no scenario\n";
+        return;
+      }
+      _replayId = _urlVec.size();
+      _urlVec.push_back("replay:" + _replay);
+    }
+    if (_search.Enabled() && (_scenario || Replaying())) {
+      std::cout << "search drives the load itself, "
+                   "no scenario or replay with it\n";
+      return;
+    }
+    if ((_procs > 1 || !_controlled.empty()) &&
+        (_search.Enabled() || _detail)) {
+      std::cout << "search and detail run in a single process only\n";
+      return;
+    }
+    if ((_procs > 1 || !_controlled.empty()) &&
+        _phases.size() > MAX_SHARED_PHASES) {
+      std::cout << "a scenario on several processes has at most "
+                << MAX_SHARED_PHASES << " phases\n";
+      return;
+    }
+    if (_urlIds.empty() && !_urlFile && !Replaying()) {
+      return;
+    }
+    if (_select != SELECT_RR) {
+      _entries = _urlIds.size() + (_urlFile ? _urlFile->Count() : 0);
+    }
+
+    if (_search.Enabled()) {
+      _search.AddPhases(&_phases);
+    } else if (!_scenario) {
+      Phase phase;
+      phase._rate = _interval > 0 ? 1e6 / _interval : -1;
+      phase._sessions = _clients;
+      if (!_clients) {
+        // no sessions to open; 0 would mean no cap
+        phase._duration = 0;
+      }
+      _phases.push_back(phase);
+    }
+
+    _ready = BuildSelection();
+  }
+
+  // Config file URLs come first, then the command line ones; a URL listed
+  // twice keeps its id and is played twice as often. Weights missing for
+  // the URLs are 1.
+  void InternURLs(const std::vector<std::string>& urls,
+                  const std::vector<double>& weights) {
+    boost::unordered_map<std::string, uint32_t> ids;
+    for (size_t i = 0; i < _urlVec.size(); i++) {
+      ids[_urlVec[i]] = i;
+    }
+    for (size_t i = 0; i < urls.size(); i++) {
+      if (urls[i].empty()) {
+        continue;
+      }
+      std::pair<boost::unordered_map<std::string, uint32_t>::iterator, bool>
+        res = ids.insert(std::make_pair(urls[i], uint32_t(_urlVec.size())));
+      if (res.second) {
+        _urlVec.push_back(urls[i]);
+      }
+      _urlIds.push_back(res.first->second);
+      _weights.push_back(i < weights.size() ? weights[i] : 1.0);
+    }
+  }
+
+  // Alias table over all entries for the weighted policies; file lines
+  // weigh 1, zipf ranks the entries in listed order.
+  bool BuildSelection() {
+    std::vector<double> weights;
+    if (!_entries) {
+      return true;
+    } else if (_select == SELECT_WEIGHTED) {
+      weights = _weights;
+      weights.resize(_entries, 1.0);
+    } else if (_select == SELECT_ZIPF) {
+      weights = ZipfWeights(_zipfExponent, _entries);
+    } else {
+      return true;
+    }
+    _alias.reset(new AliasTable());
+    if (_entries > UINT32_MAX || !_alias->Build(weights)) {
+      std::cout << "no url has a positive weight\n";
+      return false;
+    }
+    return true;
+  }
+
+  bool ParseWatchTime(const std::string& spec) {
+    _watch = WatchTime();
+    if (!_watch.Parse(spec)) {
+      std::cout << "bad watch time: " << spec << "\n";
+      return false;
+    }
+    return true;
+  }
+
+  bool ParseSearch(const std::string& spec) {
+    if (!_search.Parse(spec)) {
+      std::cout << "bad search: " << spec << "\n";
+      return false;
+    }
+    return true;
+  }
+
+  bool ParseProbe(const std::string& spec) {
+    if (!_search.ParseProbe(spec)) {
+      std::cout << "bad probe: " << spec << "\n";
+      return false;
+    }
+    return true;
+  }
 
-    std::merge(urlVec1.begin(), urlVec1.end(),
-               urlVec2.begin(), urlVec2.end(), std::back_inserter(_urlVec));
+  bool ParseSLO(const std::string& spec) {
+    if (!_search.Objective().Parse(spec)) {
+      std::cout << "bad slo: " << spec << "\n";
+      return false;
+    }
+    return true;
+  }
 
-    _ready = !_urlVec.empty();
+  bool ParseSelectPolicy(const std::string& policy) {
+    if (policy == "rr") {
+      _select = SELECT_RR;
+    } else if (policy == "random") {
+      _select = SELECT_RANDOM;
+    } else if (policy == "weighted") {
+      _select = SELECT_WEIGHTED;
+    } else if (policy.compare(0, 4, "zipf") == 0 &&
+               (policy.size() == 4 || policy[4] == ':')) {
+      _select = SELECT_ZIPF;
+      if (policy.size() > 4) {
+        char* end = NULL;
+        _zipfExponent = strtod(policy.c_str() + 5, &end);
+        if (*end || end == policy.c_str() + 5 || _zipfExponent < 0) {
+          std::cout << "bad zipf exponent: " << policy << "\n";
+          return false;
+        }
+      }
+    } else {
+      std::cout << "unknown url selection: " << policy << "\n";
+      return false;
+    }
+    return true;
+  }
+
+  // Splits on commas and blanks, except inside template braces.
+  static void SplitURLs(const std::string& urls,
+                        std::vector<std::string>* result) {
+    std::string url;
+    int depth = 0;
+    for (size_t i = 0; i <= urls.size(); i++) {
+      char c = i < urls.size() ? urls[i] : ',';
+      if (c == '{') {
+        depth++;
+      } else if (c == '}' && depth) {
+        depth--;
+      } else if (!depth &&
+                 (c == ',' || c == ' ' || c == '\n' || c == '\t')) {
+        if (!url.empty()) {
+          result->push_back(url);
+          url.clear();
+        }
+        continue;
+      }
+      url.push_back(c);
+    }
+  }
+
+  bool ParseTemplates() {
+    for (size_t id = 0; id < _urlVec.size(); id++) {
+      if (!URLTemplate::IsTemplate(_urlVec[id])) {
+        continue;
+      }
+      boost::shared_ptr<URLTemplate> t(new URLTemplate());
+      if (!t->Parse(_urlVec[id])) {
+        std::cout << "bad url template: " << _urlVec[id] << "\n";
+        return false;
+      }
+      _templates.resize(_urlVec.size());
+      _templates[id] = t;
+    }
+    return true;
+  }
+
+  bool ParseURLs() {
+    _parsedURLs.resize(_urlVec.size());
+    for (size_t id = 0; id < _urlVec.size(); id++) {
+      if (IsTemplate(id)) {
+        continue;
+      }
+      boost::system::error_code ec;
+      _parsedURLs[id] = urdl::url::from_string(_urlVec[id], ec);
+      if (ec) {
+        std::cout << "bad url: " << _urlVec[id] << "\n";
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool ParseRecvMode(const std::string& mode) {
+    if (mode == "block") {
+      _recvMode = RECV_BLOCK;
+    } else if (mode == "drain") {
+      _recvMode = RECV_DRAIN;
+    } else if (mode == "uring") {
+      _recvMode = RECV_URING;
+    } else {
+      std::cout << "unknown recvmode: " << mode << "\n";
+      return false;
+    }
+    return true;
   }
 
 private:
   std::string _helpMessage;
   std::vector<std::string> _urlVec;
+  std::vector<urdl::url> _parsedURLs;
   bool _ready;
   size_t _clients;
   size_t _recvLen;
   int32_t _interval;
   int32_t _timeout;
   bool _detail;
+  RecvMode _recvMode;
+  size_t _requests;
+  bool _pipeline;
+  std::string _range;
+  std::vector<uint32_t> _urlIds;
+  std::vector<double> _weights;
+  boost::shared_ptr<URLFile> _urlFile;
+  std::vector<boost::shared_ptr<URLTemplate> > _templates;
+  FastRandom _random;
+  SelectPolicy _select;
+  double _zipfExponent;
+  size_t _entries;
+  boost::shared_ptr<AliasTable> _alias;
+  std::vector<Phase> _phases;
+  bool _scenario;
+  WatchTime _watch;
+  bool _replace;
+  std::string _replay;
+  size_t _replayId;
+  size_t _fileId;
+  double _speedup;
+  double _scale;
+  CapacitySearch _search;
+  size_t _procs;
+  size_t _sliceIndex;
+  size_t _sliceCount;
+  std::vector<std::string> _args;
+  std::vector<std::string> _agentArgs;
+  std::string _configText;
+  bool _configLoaded;
+  std::string _agent;
+  std::vector<std::string> _controlled;
 };
 
 #endif // TEST_CONFIG_HH_INCLUDED
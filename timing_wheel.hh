@@ -0,0 +1,195 @@
+#ifndef TIMING_WHEEL_HH_INCLUDED
+#define TIMING_WHEEL_HH_INCLUDED
+
+#include <stdint.h>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/chrono/include.hpp>
+#include <boost/noncopyable.hpp>
+
+// Two-level hashed timing wheel shared by all sessions of one io_service.
+// Entries are intrusive, so scheduling and removal are O(1); a single
+// timer drives the ticks while any entry is pending.
+class TimingWheel : private boost::noncopyable {
+public:
+  static const int TICK_MS = 100;
+  static const uint32_t NEAR_BITS = 8;
+  static const uint32_t FAR_BITS = 6;
+  static const uint32_t NEAR_SIZE = 1 << NEAR_BITS;
+  static const uint32_t FAR_SIZE = 1 << FAR_BITS;
+
+  class Entry {
+  public:
+    Entry() : _prev(NULL), _next(NULL), _expiry(0) {}
+    virtual ~Entry() {}
+    virtual void OnTimer() {}
+
+    bool Scheduled() const {
+      return _prev != NULL;
+    }
+
+  private:
+    friend class TimingWheel;
+    Entry* _prev;
+    Entry* _next;
+    uint64_t _expiry;
+  };
+
+  explicit TimingWheel(boost::asio::io_service& ioServ)
+    : _timer(ioServ)
+    , _now(0)
+    , _count(0)
+    , _running(false) {
+    for (uint32_t i = 0; i < NEAR_SIZE; i++) InitSlot(&_near[i]);
+    for (uint32_t i = 0; i < FAR_SIZE; i++) InitSlot(&_far[i]);
+    _start = boost::chrono::steady_clock::now();
+  }
+
+  // Current time in ticks; only advanced by the tick handler while
+  // entries are pending, so reading it is free on the hot path.
+  uint64_t Now() {
+    if (!_running) {
+      _now = ElapsedTicks();
+    }
+    return _now;
+  }
+
+  static uint64_t SecondsToTicks(int32_t sec) {
+    return uint64_t(sec) * 1000 / TICK_MS;
+  }
+
+  static uint64_t MillisToTicks(int64_t ms) {
+    return uint64_t(ms + TICK_MS - 1) / TICK_MS;
+  }
+
+  void Schedule(Entry* e, uint64_t expiry) {
+    Remove(e);
+    e->_expiry = std::max(expiry, Now() + 1);
+    Place(e);
+    _count++;
+    if (!_running) {
+      _running = true;
+      ArmTick();
+    }
+  }
+
+  void Remove(Entry* e) {
+    if (!e->Scheduled()) {
+      return;
+    }
+    Unlink(e);
+    _count--;
+  }
+
+private:
+  static void InitSlot(Entry* head) {
+    head->_prev = head->_next = head;
+  }
+
+  static void Unlink(Entry* e) {
+    e->_prev->_next = e->_next;
+    e->_next->_prev = e->_prev;
+    e->_prev = e->_next = NULL;
+  }
+
+  static void Append(Entry* head, Entry* e) {
+    e->_prev = head->_prev;
+    e->_next = head;
+    head->_prev->_next = e;
+    head->_prev = e;
+  }
+
+  void Place(Entry* e) {
+    uint64_t delta = e->_expiry > _now ? e->_expiry - _now : 0;
+    if (delta < NEAR_SIZE) {
+      Append(&_near[e->_expiry & (NEAR_SIZE - 1)], e);
+    } else if (delta < (uint64_t(NEAR_SIZE) << FAR_BITS)) {
+      Append(&_far[(e->_expiry >> NEAR_BITS) & (FAR_SIZE - 1)], e);
+    } else {
+      // beyond the far wheel, parked in the last slot and re-placed later
+      Append(&_far[((_now >> NEAR_BITS) + FAR_SIZE - 1) & (FAR_SIZE - 1)], e);
+    }
+  }
+
+  // Moves a whole slot to a local list, so entries scheduled from the
+  // callbacks never land in the list being walked.
+  static void Detach(Entry* head, Entry* pending) {
+    InitSlot(pending);
+    if (head->_next == head) {
+      return;
+    }
+    pending->_next = head->_next;
+    pending->_prev = head->_prev;
+    pending->_next->_prev = pending;
+    pending->_prev->_next = pending;
+    InitSlot(head);
+  }
+
+  void Tick() {
+    _now++;
+    Entry pending;
+    if ((_now & (NEAR_SIZE - 1)) == 0) {
+      Detach(&_far[(_now >> NEAR_BITS) & (FAR_SIZE - 1)], &pending);
+      while (pending._next != &pending) {
+        Entry* e = pending._next;
+        Unlink(e);
+        Place(e);
+      }
+    }
+
+    Detach(&_near[_now & (NEAR_SIZE - 1)], &pending);
+    while (pending._next != &pending) {
+      Entry* e = pending._next;
+      Unlink(e);
+      if (e->_expiry <= _now) {
+        _count--;
+        e->OnTimer();
+      } else {
+        Place(e);
+      }
+    }
+  }
+
+  uint64_t ElapsedTicks() const {
+    boost::chrono::milliseconds elapsed =
+      boost::chrono::duration_cast<boost::chrono::milliseconds>(
+        boost::chrono::steady_clock::now() - _start);
+    return elapsed.count() / TICK_MS;
+  }
+
+  void ArmTick() {
+    _timer.expires_at(_start + boost::chrono::milliseconds(
+      (_now + 1) * TICK_MS));
+    _timer.async_wait(boost::bind(&TimingWheel::HandleTick, this,
+      boost::asio::placeholders::error));
+  }
+
+  void HandleTick(const boost::system::error_code& err) {
+    if (err) {
+      _running = false;
+      return;
+    }
+    uint64_t target = ElapsedTicks();
+    while (_now < target) {
+      Tick();
+    }
+    if (_count) {
+      ArmTick();
+    } else {
+      _running = false;
+    }
+  }
+
+  typedef boost::asio::basic_waitable_timer<
+    boost::chrono::steady_clock> steady_timer;
+
+  steady_timer _timer;
+  boost::chrono::steady_clock::time_point _start;
+  uint64_t _now;
+  size_t _count;
+  bool _running;
+  Entry _near[NEAR_SIZE];
+  Entry _far[FAR_SIZE];
+};
+
+#endif // TIMING_WHEEL_HH_INCLUDED
@@ -0,0 +1,359 @@
+#ifndef URING_REACTOR_HH_INCLUDED
+#define URING_REACTOR_HH_INCLUDED
+
+#include <vector>
+#include <cerrno>
+#include <cstring>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/noncopyable.hpp>
+
+// Receive engine built on io_uring: every armed socket gets one multishot
+// IORING_OP_RECV that picks its buffers from a provided buffer ring, so a
+// busy stream costs one CQE per filled buffer and no syscall per read.
+// The ring fd is watched through the asio io_service, which keeps all
+// callbacks on the same thread as the rest of the sessions.
+class UringReactor : private boost::noncopyable {
+public:
+  static const unsigned SQ_ENTRIES = 4096;
+  static const unsigned CQ_ENTRIES = 32768;
+  static const unsigned BUF_ENTRIES = 4096;
+  static const unsigned BUF_SIZE = 16 * 1024;
+  static const uint16_t BUF_GROUP = 0;
+
+  struct Receiver {
+    virtual void OnUringData(const char* data, size_t len) = 0;
+    // res == 0 on EOF, -errno otherwise
+    virtual void OnUringEnd(int res) = 0;
+  };
+
+  explicit UringReactor(boost::asio::io_service& ioServ)
+    : _ioServ(ioServ)
+    , _ringDesc(ioServ)
+    , _ringFd(-1)
+    , _sqRing(MAP_FAILED)
+    , _cqRing(MAP_FAILED)
+    , _sqes(MAP_FAILED)
+    , _bufRing(MAP_FAILED)
+    , _bufSlab(MAP_FAILED)
+    , _sqRingSize(0)
+    , _cqRingSize(0)
+    , _queued(0)
+    , _flushPosted(false) {
+  }
+
+  ~UringReactor() {
+    _ringDesc.release();
+    if (_bufSlab != MAP_FAILED) munmap(_bufSlab, BUF_ENTRIES * BUF_SIZE);
+    if (_bufRing != MAP_FAILED)
+      munmap(_bufRing, BUF_ENTRIES * sizeof(struct io_uring_buf));
+    if (_sqes != MAP_FAILED)
+      munmap(_sqes, _params.sq_entries * sizeof(struct io_uring_sqe));
+    if (_cqRing != MAP_FAILED && _cqRing != _sqRing)
+      munmap(_cqRing, _cqRingSize);
+    if (_sqRing != MAP_FAILED) munmap(_sqRing, _sqRingSize);
+    if (_ringFd >= 0) close(_ringFd);
+  }
+
+  // Returns false when the running kernel cannot provide the ring or the
+  // provided buffer group; callers then stay on the asio reactor.
+  bool Init() {
+    memset(&_params, 0, sizeof(_params));
+    _params.flags = IORING_SETUP_CQSIZE;
+    _params.cq_entries = CQ_ENTRIES;
+    _ringFd = syscall(__NR_io_uring_setup, SQ_ENTRIES, &_params);
+    if (_ringFd < 0) {
+      return false;
+    }
+
+    _sqRingSize = _params.sq_off.array + _params.sq_entries * sizeof(unsigned);
+    _cqRingSize = _params.cq_off.cqes +
+                  _params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single = (_params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single) {
+      _sqRingSize = _cqRingSize = std::max(_sqRingSize, _cqRingSize);
+    }
+
+    _sqRing = mmap(0, _sqRingSize, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, _ringFd, IORING_OFF_SQ_RING);
+    if (_sqRing == MAP_FAILED) {
+      return false;
+    }
+    _cqRing = single ? _sqRing :
+              mmap(0, _cqRingSize, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, _ringFd, IORING_OFF_CQ_RING);
+    if (_cqRing == MAP_FAILED) {
+      return false;
+    }
+    _sqes = mmap(0, _params.sq_entries * sizeof(struct io_uring_sqe),
+                 PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                 _ringFd, IORING_OFF_SQES);
+    if (_sqes == MAP_FAILED) {
+      return false;
+    }
+
+    char* sq = static_cast<char*>(_sqRing);
+    _sqHead = reinterpret_cast<unsigned*>(sq + _params.sq_off.head);
+    _sqTail = reinterpret_cast<unsigned*>(sq + _params.sq_off.tail);
+    _sqMask = *reinterpret_cast<unsigned*>(sq + _params.sq_off.ring_mask);
+    _sqArray = reinterpret_cast<unsigned*>(sq + _params.sq_off.array);
+    char* cq = static_cast<char*>(_cqRing);
+    _cqHead = reinterpret_cast<unsigned*>(cq + _params.cq_off.head);
+    _cqTail = reinterpret_cast<unsigned*>(cq + _params.cq_off.tail);
+    _cqMask = *reinterpret_cast<unsigned*>(cq + _params.cq_off.ring_mask);
+    _cqes = reinterpret_cast<struct io_uring_cqe*>(cq + _params.cq_off.cqes);
+
+    _bufRing = mmap(0, BUF_ENTRIES * sizeof(struct io_uring_buf),
+                    PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    _bufSlab = mmap(0, BUF_ENTRIES * BUF_SIZE, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (_bufRing == MAP_FAILED || _bufSlab == MAP_FAILED) {
+      return false;
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(_bufRing);
+    reg.ring_entries = BUF_ENTRIES;
+    reg.bgid = BUF_GROUP;
+    if (syscall(__NR_io_uring_register, _ringFd,
+                IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+      return false;
+    }
+
+    struct io_uring_buf_ring* br =
+      static_cast<struct io_uring_buf_ring*>(_bufRing);
+    _bufTail = 0;
+    for (unsigned i = 0; i < BUF_ENTRIES; i++) {
+      PutBuffer(i);
+    }
+    __atomic_store_n(&br->tail, _bufTail, __ATOMIC_RELEASE);
+
+    _ringDesc.assign(_ringFd);
+    AsyncWait();
+    return true;
+  }
+
+  // Starts a multishot receive on fd; the returned token identifies the
+  // registration for Cancel().
+  uint64_t Arm(int fd, Receiver* recv) {
+    uint32_t index;
+    if (_freeSlots.empty()) {
+      index = _slots.size();
+      _slots.push_back(Slot());
+    } else {
+      index = _freeSlots.back();
+      _freeSlots.pop_back();
+    }
+    Slot& slot = _slots[index];
+    slot._recv = recv;
+    slot._fd = fd;
+    uint64_t token = (uint64_t(slot._gen) << 32) | index;
+    PrepareRecv(fd, token);
+    return token;
+  }
+
+  void Cancel(uint64_t token) {
+    Slot* slot = Lookup(token);
+    if (!slot) {
+      return;
+    }
+    struct io_uring_sqe* sqe = GetSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = token;
+    sqe->user_data = CANCEL_TAG;
+    Release(uint32_t(token));
+    // the cancel must reach the kernel before the socket is closed
+    Flush();
+  }
+
+private:
+  static const uint64_t CANCEL_TAG = ~0ULL;
+
+  struct Slot {
+    Slot() : _recv(NULL), _fd(-1), _gen(0) {}
+    Receiver* _recv;
+    int _fd;
+    uint32_t _gen;
+  };
+
+  Slot* Lookup(uint64_t token) {
+    uint32_t index = uint32_t(token);
+    if (token == CANCEL_TAG || index >= _slots.size()) {
+      return NULL;
+    }
+    Slot& slot = _slots[index];
+    if (!slot._recv || slot._gen != uint32_t(token >> 32)) {
+      return NULL;
+    }
+    return &slot;
+  }
+
+  void Release(uint32_t index) {
+    Slot& slot = _slots[index];
+    slot._recv = NULL;
+    slot._fd = -1;
+    slot._gen++;
+    _freeSlots.push_back(index);
+  }
+
+  void PutBuffer(unsigned bid) {
+    // not &br->bufs[]: the uapi flex array is misplaced when built as C++
+    struct io_uring_buf* buf = static_cast<struct io_uring_buf*>(_bufRing) +
+                               (_bufTail & (BUF_ENTRIES - 1));
+    buf->addr = reinterpret_cast<uint64_t>(
+      static_cast<char*>(_bufSlab) + size_t(bid) * BUF_SIZE);
+    buf->len = BUF_SIZE;
+    buf->bid = bid;
+    _bufTail++;
+  }
+
+  struct io_uring_sqe* GetSqe() {
+    unsigned head = __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+    if (*_sqTail + _queued - head >= _params.sq_entries) {
+      Flush();
+      head = __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+    }
+    unsigned index = (*_sqTail + _queued) & _sqMask;
+    struct io_uring_sqe* sqe =
+      static_cast<struct io_uring_sqe*>(_sqes) + index;
+    memset(sqe, 0, sizeof(*sqe));
+    _sqArray[index] = index;
+    _queued++;
+    if (!_flushPosted) {
+      _flushPosted = true;
+      _ioServ.post(boost::bind(&UringReactor::Flush, this));
+    }
+    return sqe;
+  }
+
+  void PrepareRecv(int fd, uint64_t token) {
+    struct io_uring_sqe* sqe = GetSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUF_GROUP;
+    sqe->user_data = token;
+  }
+
+  void Flush() {
+    _flushPosted = false;
+    if (!_queued) {
+      return;
+    }
+    __atomic_store_n(_sqTail, *_sqTail + _queued, __ATOMIC_RELEASE);
+    unsigned toSubmit = _queued;
+    _queued = 0;
+    while (toSubmit) {
+      int ret = syscall(__NR_io_uring_enter, _ringFd, toSubmit, 0, 0, NULL, 0);
+      if (ret < 0) {
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EBUSY) {
+          // the CQ is backed up; reap and try again
+          Reap();
+          continue;
+        }
+        break;
+      }
+      toSubmit -= ret;
+    }
+  }
+
+  void AsyncWait() {
+    _ringDesc.async_wait(boost::asio::posix::stream_descriptor::wait_read,
+      boost::bind(&UringReactor::HandleReady, this,
+        boost::asio::placeholders::error));
+  }
+
+  void HandleReady(const boost::system::error_code& err) {
+    if (err) {
+      return;
+    }
+    Reap();
+    Flush();
+    AsyncWait();
+  }
+
+  // Each completion is consumed before it is handled: a session ending
+  // in the handler cancels and flushes, and with the CQ backed up that
+  // flush reaps as well, carrying on from the next completion. The head
+  // is read afresh every time for the same reason.
+  void Reap() {
+    struct io_uring_buf_ring* br =
+      static_cast<struct io_uring_buf_ring*>(_bufRing);
+    unsigned tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+    while (int(tail - *_cqHead) > 0) {
+      do {
+        unsigned head = *_cqHead;
+        struct io_uring_cqe* cqe = &_cqes[head & _cqMask];
+        uint64_t token = cqe->user_data;
+        int res = cqe->res;
+        unsigned flags = cqe->flags;
+        __atomic_store_n(_cqHead, head + 1, __ATOMIC_RELEASE);
+        HandleCqe(token, res, flags);
+      } while (int(tail - *_cqHead) > 0);
+      __atomic_store_n(&br->tail, _bufTail, __ATOMIC_RELEASE);
+      tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+    }
+  }
+
+  void HandleCqe(uint64_t token, int res, unsigned flags) {
+    Slot* slot = Lookup(token);
+    if (flags & IORING_CQE_F_BUFFER) {
+      unsigned bid = flags >> IORING_CQE_BUFFER_SHIFT;
+      if (slot && res > 0) {
+        slot->_recv->OnUringData(
+          static_cast<char*>(_bufSlab) + size_t(bid) * BUF_SIZE, res);
+        slot = Lookup(token);
+      }
+      PutBuffer(bid);
+    }
+    if (!slot || (flags & IORING_CQE_F_MORE)) {
+      return;
+    }
+
+    // the multishot request has terminated
+    if (res > 0 || res == -ENOBUFS) {
+      PrepareRecv(slot->_fd, token);
+    } else {
+      Receiver* recv = slot->_recv;
+      Release(uint32_t(token));
+      recv->OnUringEnd(res);
+    }
+  }
+
+  boost::asio::io_service& _ioServ;
+  boost::asio::posix::stream_descriptor _ringDesc;
+  struct io_uring_params _params;
+  int _ringFd;
+  void* _sqRing;
+  void* _cqRing;
+  void* _sqes;
+  void* _bufRing;
+  void* _bufSlab;
+  size_t _sqRingSize;
+  size_t _cqRingSize;
+  unsigned* _sqHead;
+  unsigned* _sqTail;
+  unsigned _sqMask;
+  unsigned* _sqArray;
+  unsigned* _cqHead;
+  unsigned* _cqTail;
+  unsigned _cqMask;
+  struct io_uring_cqe* _cqes;
+  uint16_t _bufTail;
+  unsigned _queued;
+  bool _flushPosted;
+  std::vector<Slot> _slots;
+  std::vector<uint32_t> _freeSlots;
+};
+
+#endif // URING_REACTOR_HH_INCLUDED
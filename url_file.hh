@@ -0,0 +1,135 @@
+#ifndef URL_FILE_HH_INCLUDED
+#define URL_FILE_HH_INCLUDED
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <boost/noncopyable.hpp>
+
+// Memory-mapped list of URLs, one per line; blank lines and lines starting
+// with '#' are skipped. Nothing is copied at open: entries are located on
+// demand, and only the offset of every INDEX_STRIDE-th entry is kept, so
+// the index costs a few bytes per thousand URLs.
+class URLFile : private boost::noncopyable {
+public:
+  static const size_t INDEX_STRIDE = 64;
+
+  URLFile()
+    : _data(NULL)
+    , _size(0)
+    , _scanned(0)
+    , _count(0)
+    , _complete(false) {
+  }
+
+  ~URLFile() {
+    if (_data) {
+      munmap(const_cast<char*>(_data), _size);
+    }
+  }
+
+  bool Open(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+      close(fd);
+      return false;
+    }
+    _size = st.st_size;
+    if (_size) {
+      void* data = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data == MAP_FAILED) {
+        close(fd);
+        _size = 0;
+        return false;
+      }
+      _data = static_cast<const char*>(data);
+    }
+    close(fd);
+    _complete = !_size;
+    return true;
+  }
+
+  // Whether entry index exists; indexes the file only up to it.
+  bool Has(size_t index) const {
+    IndexUpTo(index);
+    return index < _count;
+  }
+
+  // Scans the whole file the first time.
+  size_t Count() const {
+    IndexUpTo(size_t(-1));
+    return _count;
+  }
+
+  std::string Entry(size_t index) const {
+    if (!Has(index)) {
+      return std::string();
+    }
+    size_t pos = _offsets[index / INDEX_STRIDE];
+    for (size_t i = index % INDEX_STRIDE; i; i--) {
+      pos = SkipToEntry(LineEnd(pos) + 1);
+    }
+    size_t end = LineEnd(pos);
+    while (end > pos && IsSpace(_data[end - 1])) {
+      end--;
+    }
+    return std::string(_data + pos, end - pos);
+  }
+
+private:
+  static bool IsSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+  }
+
+  size_t LineEnd(size_t pos) const {
+    const void* nl = memchr(_data + pos, '\n', _size - pos);
+    return nl ? static_cast<const char*>(nl) - _data : _size;
+  }
+
+  // First entry starting at or after pos, _size when none is left.
+  size_t SkipToEntry(size_t pos) const {
+    while (pos < _size) {
+      while (pos < _size && IsSpace(_data[pos])) {
+        pos++;
+      }
+      if (pos < _size && _data[pos] != '\n' && _data[pos] != '#') {
+        return pos;
+      }
+      pos = LineEnd(pos) + 1;
+    }
+    return _size;
+  }
+
+  void IndexUpTo(size_t index) const {
+    while (!_complete && _count <= index) {
+      size_t pos = SkipToEntry(_scanned);
+      if (pos >= _size) {
+        _complete = true;
+        break;
+      }
+      if (_count % INDEX_STRIDE == 0) {
+        _offsets.push_back(pos);
+      }
+      _count++;
+      _scanned = LineEnd(pos) + 1;
+    }
+  }
+
+  const char* _data;
+  size_t _size;
+  mutable std::vector<uint64_t> _offsets;
+  mutable size_t _scanned;
+  mutable size_t _count;
+  mutable bool _complete;
+};
+
+#endif // URL_FILE_HH_INCLUDED
@@ -0,0 +1,164 @@
+#ifndef URL_TEMPLATE_HH_INCLUDED
+#define URL_TEMPLATE_HH_INCLUDED
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <stdint.h>
+#include <boost/smart_ptr.hpp>
+#include "distributions.hh"
+
+// URL with generated parts, expanded anew for every session:
+//   {first..last}         counts through the range, one step per session
+//                         (a leading zero in first pads to its width)
+//   {rand:uniform(n)}     uniform pick in 0..n-1
+//   {rand:zipf(s,n)}      rank 0..n-1 drawn with Zipf exponent s
+// Several counters in one template advance like an odometer, the last
+// one fastest.
+class URLTemplate {
+public:
+  static bool IsTemplate(const std::string& text) {
+    return text.find('{') != std::string::npos;
+  }
+
+  URLTemplate()
+    : _sequence(0)
+    , _stride(1) {
+  }
+
+  bool Parse(const std::string& text) {
+    _parts.clear();
+    size_t pos = 0;
+    while (pos < text.size()) {
+      size_t open = text.find('{', pos);
+      size_t close = open == std::string::npos ?
+                       open : text.find('}', open);
+      if (open == std::string::npos) {
+        AddLiteral(text.substr(pos));
+        break;
+      }
+      if (close == std::string::npos) {
+        return false;
+      }
+      AddLiteral(text.substr(pos, open - pos));
+      if (!AddGenerator(text.substr(open + 1, close - open - 1))) {
+        return false;
+      }
+      pos = close + 1;
+    }
+    return true;
+  }
+
+  // Counts through every count-th step only, starting at index, so that
+  // count processes sharing the template take turns; slices compose.
+  void Slice(size_t index, size_t count) {
+    _sequence += index * _stride;
+    _stride *= count;
+  }
+
+  std::string Expand(FastRandom& rnd) {
+    std::string url;
+    uint64_t seq = _sequence;
+    _sequence += _stride;
+    char digits[32];
+
+    // counters take their digits from the sequence, last one first
+    std::vector<uint64_t> counts(_parts.size());
+    for (size_t i = _parts.size(); i-- > 0; ) {
+      const Part& part = _parts[i];
+      if (part._kind == RANGE) {
+        uint64_t span = part._last - part._first + 1;
+        counts[i] = part._first + seq % span;
+        seq /= span;
+      }
+    }
+
+    for (size_t i = 0; i < _parts.size(); i++) {
+      const Part& part = _parts[i];
+      uint64_t value = 0;
+      switch (part._kind) {
+      case LITERAL:
+        url.append(part._text);
+        continue;
+      case RANGE:
+        value = counts[i];
+        break;
+      case UNIFORM:
+        value = rnd.Below(part._last);
+        break;
+      case ZIPF:
+        value = part._table->Sample(rnd);
+        break;
+      }
+      snprintf(digits, sizeof(digits), "%0*llu",
+               part._width, (unsigned long long)value);
+      url.append(digits);
+    }
+    return url;
+  }
+
+private:
+  enum Kind {
+    LITERAL,
+    RANGE,
+    UNIFORM,
+    ZIPF
+  };
+
+  struct Part {
+    Part() : _kind(LITERAL), _first(0), _last(0), _width(0) {}
+    Kind _kind;
+    std::string _text;
+    uint64_t _first;
+    uint64_t _last;
+    int _width;
+    boost::shared_ptr<AliasTable> _table;
+  };
+
+  void AddLiteral(const std::string& text) {
+    if (text.empty()) {
+      return;
+    }
+    Part part;
+    part._text = text;
+    _parts.push_back(part);
+  }
+
+  bool AddGenerator(const std::string& spec) {
+    Part part;
+    unsigned long long first, last, n;
+    double s;
+    int used = 0;
+    if (sscanf(spec.c_str(), "%llu..%llu%n", &first, &last, &used) == 2 &&
+        used == int(spec.size()) && first <= last &&
+        last - first < ~0ULL) {
+      part._kind = RANGE;
+      part._first = first;
+      part._last = last;
+      if (spec.size() > 1 && spec[0] == '0' && spec[1] != '.') {
+        part._width = spec.find('.');
+      }
+    } else if (sscanf(spec.c_str(), "rand:uniform(%llu)%n", &n, &used) == 1 &&
+               used == int(spec.size()) && n > 0) {
+      part._kind = UNIFORM;
+      part._last = n;
+    } else if (sscanf(spec.c_str(), "rand:zipf(%lf,%llu)%n",
+                      &s, &n, &used) == 2 &&
+               used == int(spec.size()) && n > 0 && n <= UINT32_MAX) {
+      part._kind = ZIPF;
+      part._table.reset(new AliasTable());
+      part._table->Build(ZipfWeights(s, n));
+    } else {
+      return false;
+    }
+    _parts.push_back(part);
+    return true;
+  }
+
+  std::vector<Part> _parts;
+  uint64_t _sequence;
+  uint64_t _stride;
+};
+
+#endif // URL_TEMPLATE_HH_INCLUDED
@@ -0,0 +1,290 @@
+#ifndef WORKER_POOL_HH_INCLUDED
+#define WORKER_POOL_HH_INCLUDED
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <sys/prctl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/chrono/include.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/smart_ptr.hpp>
+#include "stats_board.hh"
+#include "test_arena.hh"
+#include "test_config.hh"
+
+// Runs the test in Procs() forked worker processes, each a TestArena on
+// its slice of the load, so that per process limits (fd table, allocator,
+// a single loop) stop being the test's. Workers publish their overall
+// summary to a slot of shared memory; the pool collects the slots, and
+// unless quiet prints a combined line every LIVE_INTERVAL_MS. Per URL,
+// edge and phase tables stay inside the workers.
+class WorkerPool : private boost::noncopyable {
+public:
+  typedef boost::asio::io_service io_service;
+  typedef boost::asio::basic_waitable_timer<
+    boost::chrono::steady_clock> steady_timer;
+  typedef boost::function<void ()> DoneHandler;
+
+  static const int LIVE_INTERVAL_MS = 1000;
+
+  explicit WorkerPool(const TestConfig& cfg, bool quiet = false)
+    : _cfg(cfg)
+    , _quiet(quiet)
+    , _parent(getpid())
+    , _running(0)
+    , _board("worker")
+    , _interrupted(false) {
+  }
+
+  // On a loop of its own, forwarding SIGINT/SIGTERM to the workers.
+  void Run() {
+    _ownIoServ.reset(new io_service());
+    if (!Start(*_ownIoServ, boost::bind(&io_service::stop,
+                                        _ownIoServ.get()))) {
+      return;
+    }
+    _signals.reset(new boost::asio::signal_set(*_ownIoServ,
+                                               SIGINT, SIGTERM));
+    _signals->async_wait(boost::bind(&WorkerPool::SignalHandler, this,
+      boost::asio::placeholders::error,
+      boost::asio::placeholders::signal_number));
+    _ownIoServ->run();
+  }
+
+  // Forks the workers and serves them from ioServ; done is called once
+  // the last one is reaped. False when no worker could be started.
+  bool Start(io_service& ioServ, const DoneHandler& done) {
+    size_t procs = std::max(_cfg.Procs(), size_t(1));
+    if (!_slots.Create(procs)) {
+      std::cout << "can not map shared stats (" << strerror(errno) << ")\n";
+      return false;
+    }
+    _board.Resize(procs);
+    std::cout.flush();
+    ioServ.notify_fork(io_service::fork_prepare);
+    for (size_t i = 0; i < procs; i++) {
+      pid_t pid = fork();
+      if (pid == 0) {
+        ioServ.notify_fork(io_service::fork_child);
+        RunWorker(i, procs);
+      } else if (pid < 0) {
+        std::cout << "fork failed (" << strerror(errno) << ")\n";
+        break;
+      }
+      _workers.push_back(Worker(pid));
+    }
+    ioServ.notify_fork(io_service::fork_parent);
+    _running = _workers.size();
+    if (!_running) {
+      return false;
+    }
+
+    _done = done;
+    _children.reset(new boost::asio::signal_set(ioServ, SIGCHLD));
+    _children->async_wait(boost::bind(&WorkerPool::ChildHandler, this,
+      boost::asio::placeholders::error));
+    _liveTimer.reset(new steady_timer(ioServ));
+    if (!_quiet) {
+      _liveTimer->expires_from_now(
+        boost::chrono::milliseconds(LIVE_INTERVAL_MS));
+      _liveTimer->async_wait(boost::bind(&WorkerPool::Live, this,
+        boost::asio::placeholders::error));
+    }
+    // workers may have ended before SIGCHLD was caught
+    ioServ.post(boost::bind(&WorkerPool::Reap, this));
+    return true;
+  }
+
+  // Passes a signal on to the workers still running.
+  void Interrupt(int signo) {
+    for (size_t i = 0; i < _workers.size(); i++) {
+      if (!_workers[i]._exited) {
+        kill(_workers[i]._pid, signo);
+      }
+    }
+  }
+
+  size_t Running() const {
+    return _running;
+  }
+
+  // Takes the latest clean copy of every slot.
+  void Collect() {
+    WorkerStats stats;
+    for (size_t i = 0; i < _board.Size(); i++) {
+      if (_slots.Read(i, &stats)) {
+        _board[i] = stats;
+      }
+    }
+  }
+
+  const StatsBoard& Board() const {
+    return _board;
+  }
+
+  // workers that did not exit cleanly with their final stats
+  size_t Failed() const {
+    size_t failed = 0;
+    for (size_t i = 0; i < _workers.size(); i++) {
+      const Worker& worker = _workers[i];
+      failed += !worker._exited || !WIFEXITED(worker._status) ||
+                WEXITSTATUS(worker._status) || !_board[i]._done;
+    }
+    return failed;
+  }
+
+  void PrintResult() const {
+    if (_workers.empty()) {
+      return;
+    }
+    std::vector<std::string> names, states;
+    for (size_t i = 0; i < _workers.size(); i++) {
+      std::stringstream name;
+      name << "worker " << i << " (pid " << _workers[i]._pid << ")";
+      names.push_back(name.str());
+      states.push_back(ExitStatus(i));
+    }
+    _board.PrintResult(names, states, _cfg.Phases());
+  }
+
+private:
+  struct Worker {
+    explicit Worker(pid_t pid)
+      : _pid(pid)
+      , _status(0)
+      , _exited(false) {
+    }
+    pid_t _pid;
+    int _status;
+    bool _exited;
+  };
+
+  // Never returns. The worker leaves the terminal's process group, so
+  // that a ^C reaches it once, through the parent, and dies with it.
+  void RunWorker(size_t index, size_t procs) {
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    if (getppid() != _parent) {
+      _exit(1);
+    }
+    setpgid(0, 0);
+
+    TestConfig cfg = _cfg;
+    cfg.Slice(index, procs);
+    {
+      TestArena arena;
+      arena.SetConfig(cfg);
+      arena.SetWorker(&_slots, index);
+      arena.Run();
+    }
+    std::cout.flush();
+    _exit(0);
+  }
+
+  void SignalHandler(const boost::system::error_code& err, int signo) {
+    if (err) {
+      return;
+    }
+    if (_interrupted) {
+      std::cout << "\nQuitting\n";
+    } else {
+      std::cout << "\nInterrupting test loop, draining " << _running
+                << " workers (signal again to quit)\n";
+    }
+    _interrupted = true;
+    Interrupt(signo);
+    _signals->async_wait(boost::bind(&WorkerPool::SignalHandler, this,
+      boost::asio::placeholders::error,
+      boost::asio::placeholders::signal_number));
+  }
+
+  void ChildHandler(const boost::system::error_code& err) {
+    if (err || !_running) {
+      return;
+    }
+    Reap();
+    if (_running) {
+      _children->async_wait(boost::bind(&WorkerPool::ChildHandler, this,
+        boost::asio::placeholders::error));
+    }
+  }
+
+  void Reap() {
+    if (!_running) {
+      return;
+    }
+    int status = 0;
+    pid_t pid;
+    while (_running && (pid = waitpid(-1, &status, WNOHANG)) > 0) {
+      for (size_t i = 0; i < _workers.size(); i++) {
+        if (_workers[i]._pid == pid && !_workers[i]._exited) {
+          _workers[i]._exited = true;
+          _workers[i]._status = status;
+          _running--;
+        }
+      }
+    }
+    if (!_running) {
+      Collect();
+      _liveTimer->cancel();
+      _children->cancel();
+      if (_signals) {
+        _signals->cancel();
+      }
+      _done();
+    }
+  }
+
+  void Live(const boost::system::error_code& err) {
+    if (err) {
+      return;
+    }
+    Collect();
+    _board.PrintLive(_running);
+    _liveTimer->expires_from_now(
+      boost::chrono::milliseconds(LIVE_INTERVAL_MS));
+    _liveTimer->async_wait(boost::bind(&WorkerPool::Live, this,
+      boost::asio::placeholders::error));
+  }
+
+  std::string ExitStatus(size_t i) const {
+    std::stringstream stream;
+    const Worker& worker = _workers[i];
+    if (!worker._exited) {
+      stream << "still running";
+    } else if (WIFSIGNALED(worker._status)) {
+      stream << "killed by signal " << WTERMSIG(worker._status);
+    } else {
+      stream << "exit " << WEXITSTATUS(worker._status);
+    }
+    if (!_board[i]._done) {
+      stream << ", final stats missing";
+    }
+    return stream.str();
+  }
+
+  TestConfig _cfg;
+  bool _quiet;
+  pid_t _parent;
+  WorkerSlots _slots;
+  std::vector<Worker> _workers;
+  size_t _running;
+  StatsBoard _board;
+  DoneHandler _done;
+  // declared first among the loop objects, so destroyed after them
+  boost::scoped_ptr<io_service> _ownIoServ;
+  boost::scoped_ptr<boost::asio::signal_set> _signals;
+  boost::scoped_ptr<boost::asio::signal_set> _children;
+  boost::scoped_ptr<steady_timer> _liveTimer;
+  bool _interrupted;
+};
+
+#endif // WORKER_POOL_HH_INCLUDED